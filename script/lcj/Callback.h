@@ -0,0 +1,34 @@
+#pragma once
+
+#include <utility>
+
+// Keeps the script loaded while the game calls back into it. Wrap every function handed to the
+// game, and unregister it from a static destructor, which runs before the script is unloaded:
+//
+//     static auto listener = bus.emplaceListener<Event>(lcj::guarded([](Event& ev) { ... }));
+
+extern "C" {
+// provided by LeviCppJit for every script dylib
+extern char lcj_dylib_calls;
+
+void lcj_call_enter(void* calls);
+void lcj_call_leave(void* calls);
+}
+
+namespace lcj {
+struct CallScope {
+    CallScope() noexcept { lcj_call_enter(&lcj_dylib_calls); }
+    ~CallScope() { lcj_call_leave(&lcj_dylib_calls); }
+
+    CallScope(CallScope const&)            = delete;
+    CallScope& operator=(CallScope const&) = delete;
+};
+
+template <class Fn>
+auto guarded(Fn&& fn) {
+    return [fn = std::forward<Fn>(fn)](auto&&... args) mutable -> decltype(auto) {
+        CallScope scope;
+        return fn(std::forward<decltype(args)>(args)...);
+    };
+}
+} // namespace lcj
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Tick-driven coroutines for scripts. Suspended tasks are resumed in batches from the server tick,
+// so they cost neither threads nor per-task heap allocations:
+//
+//     lcj::Task run() {
+//         co_await lcj::nextTick();
+//         co_await lcj::delayTicks(20);
+//         auto value = co_await lcj::background([] { return heavyWork(); });
+//     }
+
+extern "C" {
+// scheduling record kept in the awaiter, so suspending allocates nothing besides the pooled frame
+struct lcj_task_node {
+    lcj_task_node* next;
+    void*          owner;
+    void*          frame;
+    void (*resume)(void*);
+    void (*destroy)(void*);
+    void (*work)(void*);
+    void*    data;
+    uint64_t due;
+};
+
+// provided by LeviCppJit for every script dylib
+extern char lcj_task_owner;
+
+void* lcj_coro_allocate(void* owner, size_t size);
+void  lcj_coro_deallocate(void* frame);
+void  lcj_coro_schedule(lcj_task_node* node, uint64_t ticks);
+void  lcj_coro_schedule_background(lcj_task_node* node);
+void  lcj_coro_unhandled_exception(char const* what);
+}
+
+namespace lcj {
+namespace detail {
+inline void resumeFrame(void* frame) { std::coroutine_handle<>::from_address(frame).resume(); }
+// used when the dylib is dropped with the task still suspended
+inline void destroyFrame(void* frame) { std::coroutine_handle<>::from_address(frame).destroy(); }
+
+inline lcj_task_node
+makeNode(std::coroutine_handle<> handle, void (*work)(void*) = nullptr, void* data = nullptr) {
+    return {nullptr, &lcj_task_owner, handle.address(), resumeFrame, destroyFrame, work, data, 0};
+}
+} // namespace detail
+
+// fire-and-forget task, the frame is released when the coroutine finishes
+struct Task {
+    struct promise_type {
+        static void* operator new(size_t size) { return lcj_coro_allocate(&lcj_task_owner, size); }
+        static void  operator delete(void* frame) { lcj_coro_deallocate(frame); }
+
+        Task               get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void               return_void() noexcept {}
+
+        // the exception is logged and the task dropped, the server keeps running
+        void unhandled_exception() noexcept {
+            try {
+                throw;
+            } catch (std::exception const& e) {
+                lcj_coro_unhandled_exception(e.what());
+            } catch (...) {
+                lcj_coro_unhandled_exception(nullptr);
+            }
+        }
+    };
+};
+
+struct DelayTicks {
+    uint64_t      ticks;
+    lcj_task_node node{};
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        node = detail::makeNode(handle);
+        lcj_coro_schedule(&node, ticks);
+    }
+    void await_resume() const noexcept {}
+};
+
+inline DelayTicks nextTick() noexcept { return {1}; }
+
+inline DelayTicks delayTicks(uint64_t ticks) noexcept { return {ticks}; }
+
+// runs fn on a background thread, the coroutine continues on the server thread next tick and
+// sees the result or the exception thrown by fn
+template <class Fn, class R = std::invoke_result_t<Fn&>>
+struct Background {
+    Fn                 fn;
+    std::optional<R>   result;
+    std::exception_ptr exception;
+    lcj_task_node      node{};
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        node = detail::makeNode(
+            handle,
+            [](void* self) {
+                auto& awaiter = *static_cast<Background*>(self);
+                try {
+                    awaiter.result.emplace(awaiter.fn());
+                } catch (...) {
+                    awaiter.exception = std::current_exception();
+                }
+            },
+            this
+        );
+        lcj_coro_schedule_background(&node);
+    }
+    R await_resume() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*result);
+    }
+};
+
+template <class Fn>
+struct Background<Fn, void> {
+    Fn                 fn;
+    std::exception_ptr exception;
+    lcj_task_node      node{};
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        node = detail::makeNode(
+            handle,
+            [](void* self) {
+                auto& awaiter = *static_cast<Background*>(self);
+                try {
+                    awaiter.fn();
+                } catch (...) {
+                    awaiter.exception = std::current_exception();
+                }
+            },
+            this
+        );
+        lcj_coro_schedule_background(&node);
+    }
+    void await_resume() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+template <class Fn>
+Background<std::decay_t<Fn>> background(Fn&& fn) {
+    return {std::forward<Fn>(fn)};
+}
+} // namespace lcj
@@ -101,6 +101,15 @@ function pack_plugin(target,plugin_define)
         if os.isfile(oripdbfile) then
             os.cp(oripdbfile, pdbfile)
         end
+        for _, extrafile in ipairs(plugin_define.extraFiles or {}) do
+            os.cp(extrafile, path.join(outputdir, path.filename(extrafile)))
+        end
+        for _, extradir in ipairs(plugin_define.extraDirs or {}) do
+            local sourcedir = path.join(os.projectdir(), extradir[1])
+            local targetdir = path.join(outputdir, extradir[2])
+            os.mkdir(targetdir)
+            os.cp(path.join(sourcedir, "**"), targetdir, {rootdir = sourcedir})
+        end
 
         formattedmanifest = string_formatter(manifest, plugin_define)
         io.writefile(manifestfile,formattedmanifest)
@@ -0,0 +1,288 @@
+#include "CompileWorker.h"
+
+#include "lcj/compiler/DiagnosticLogger.h"
+#include "lcj/compiler/WorkerProtocol.h"
+#include "lcj/core/LeviCppJit.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <Windows.h>
+
+namespace lcj {
+struct CompileWorker::Impl {
+    std::filesystem::path     executable;
+    std::filesystem::path     dataDir;
+    bool                      portableTarget{};
+    std::chrono::milliseconds requestTimeout{};
+
+    std::mutex mutex;
+
+    HANDLE job{};
+    HANDLE process{};
+    HANDLE input{};
+    HANDLE output{};
+
+    // kills a hung worker, which fails the blocking pipe read of the pending request
+    PTP_TIMER         watchdog{};
+    std::atomic<bool> timedOut{};
+
+    std::optional<worker::Channel> channel;
+
+    CompileMemoryStats lastCompileStats;
+
+    // replayed when the worker has to be restarted
+    std::string pchCode;
+    std::string pchFile;
+
+    bool start();
+    void stop();
+
+    static void CALLBACK onRequestTimeout(PTP_CALLBACK_INSTANCE, void* context, PTP_TIMER) {
+        auto& self    = *static_cast<Impl*>(context);
+        self.timedOut = true;
+        TerminateProcess(self.process, 1);
+    }
+
+    bool request(
+        worker::MessageKind kind,
+        std::string_view    prefix,
+        std::string_view    payload,
+        worker::Message&    result
+    );
+};
+
+bool CompileWorker::Impl::start() {
+    SECURITY_ATTRIBUTES attributes{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+
+    HANDLE childInput{}, childOutput{};
+    if (!CreatePipe(&childInput, &input, &attributes, 0)) {
+        return false;
+    }
+    if (!CreatePipe(&output, &childOutput, &attributes, 0)) {
+        CloseHandle(childInput);
+        CloseHandle(input);
+        return false;
+    }
+    SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(output, HANDLE_FLAG_INHERIT, 0);
+
+    // only the two pipe ends are inherited, not every inheritable handle of the server such as
+    // its sockets. stderr is left unset as it is not in the list.
+    HANDLE inherited[]{childInput, childOutput};
+    SIZE_T attributeListSize{};
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attributeListSize);
+    std::vector<char> attributeList(attributeListSize);
+
+    STARTUPINFOEXW startupInfo{};
+    startupInfo.StartupInfo.cb         = sizeof(startupInfo);
+    startupInfo.StartupInfo.dwFlags    = STARTF_USESTDHANDLES;
+    startupInfo.StartupInfo.hStdInput  = childInput;
+    startupInfo.StartupInfo.hStdOutput = childOutput;
+    startupInfo.lpAttributeList =
+        reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeList.data());
+
+    std::wstring commandLine = L"\"" + executable.wstring() + L"\" \"" + dataDir.wstring() + L"\"";
+    if (portableTarget) {
+        commandLine += L" --portable";
+    }
+
+    PROCESS_INFORMATION processInfo{};
+    bool                created = false;
+    if (InitializeProcThreadAttributeList(startupInfo.lpAttributeList, 1, 0, &attributeListSize)) {
+        if (UpdateProcThreadAttribute(
+                startupInfo.lpAttributeList,
+                0,
+                PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                inherited,
+                sizeof(inherited),
+                nullptr,
+                nullptr
+            )) {
+            created = CreateProcessW(
+                executable.c_str(),
+                commandLine.data(),
+                nullptr,
+                nullptr,
+                TRUE,
+                CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT,
+                nullptr,
+                nullptr,
+                &startupInfo.StartupInfo,
+                &processInfo
+            );
+        }
+        DeleteProcThreadAttributeList(startupInfo.lpAttributeList);
+    }
+    CloseHandle(childInput);
+    CloseHandle(childOutput);
+    if (!created) {
+        CloseHandle(input);
+        CloseHandle(output);
+        input = output = nullptr;
+        return false;
+    }
+    // the worker must not outlive the server
+    AssignProcessToJobObject(job, processInfo.hProcess);
+    ResumeThread(processInfo.hThread);
+    CloseHandle(processInfo.hThread);
+
+    process = processInfo.hProcess;
+    channel.emplace(output, input);
+
+    if (!pchFile.empty()) {
+        worker::Message result;
+        return request(worker::MessageKind::GeneratePch, pchFile, pchCode, result)
+            && result.kind == worker::MessageKind::Done;
+    }
+    return true;
+}
+
+void CompileWorker::Impl::stop() {
+    if (!process) {
+        return;
+    }
+    if (channel) {
+        channel->write(worker::MessageKind::Shutdown);
+        channel.reset();
+    }
+    CloseHandle(input);
+    CloseHandle(output);
+    if (WaitForSingleObject(process, 5000) != WAIT_OBJECT_0) {
+        TerminateProcess(process, 1);
+    }
+    CloseHandle(process);
+    process = input = output = nullptr;
+}
+
+bool CompileWorker::Impl::request(
+    worker::MessageKind kind,
+    std::string_view    prefix,
+    std::string_view    payload,
+    worker::Message&    result
+) {
+    if (!process && !start()) {
+        LeviCppJit::getInstance().getLogger().error("Failed to start compile worker");
+        stop();
+        return false;
+    }
+    // negative due times are relative, in 100ns units
+    int64_t  due = -requestTimeout.count() * 10'000;
+    FILETIME dueTime{static_cast<DWORD>(due), static_cast<DWORD>(due >> 32)};
+    timedOut = false;
+    SetThreadpoolTimer(watchdog, &dueTime, 0, 0);
+
+    bool answered = false;
+    if (channel->write(kind, prefix, payload)) {
+        while (channel->read(result)) {
+            if (result.kind != worker::MessageKind::Diagnostic) {
+                answered = true;
+                break;
+            }
+            DiagnosticLogger::log(
+                static_cast<clang::DiagnosticsEngine::Level>(result.param),
+                result.payload
+            );
+        }
+    }
+    SetThreadpoolTimer(watchdog, nullptr, 0, 0);
+    WaitForThreadpoolTimerCallbacks(watchdog, TRUE);
+
+    if (answered && !timedOut) {
+        return true;
+    }
+    auto& logger = LeviCppJit::getInstance().getLogger();
+    if (timedOut) {
+        logger.error(
+            "Compile worker did not answer within {} ms, restarting",
+            requestTimeout.count()
+        );
+    } else {
+        logger.error("Compile worker exited unexpectedly, restarting");
+    }
+    channel.reset();
+    stop();
+    return false;
+}
+
+CompileWorker::CompileWorker(
+    std::filesystem::path const& executable,
+    std::filesystem::path const& dataDir,
+    bool                         portableTarget,
+    std::chrono::milliseconds    requestTimeout
+)
+: impl(std::make_unique<Impl>()) {
+    impl->executable     = executable;
+    impl->dataDir        = dataDir;
+    impl->portableTarget = portableTarget;
+    impl->requestTimeout = requestTimeout;
+    impl->watchdog       = CreateThreadpoolTimer(Impl::onRequestTimeout, impl.get(), nullptr);
+
+    impl->job = CreateJobObjectW(nullptr, nullptr);
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits{};
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    SetInformationJobObject(impl->job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+}
+CompileWorker::~CompileWorker() {
+    impl->stop();
+    CloseThreadpoolTimer(impl->watchdog);
+    CloseHandle(impl->job);
+}
+
+bool CompileWorker::start() {
+    std::lock_guard lock{impl->mutex};
+
+    if (impl->process) {
+        return true;
+    }
+    if (!impl->start()) {
+        impl->stop();
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+CompileWorker::compile(std::string_view code, std::string_view name) {
+    std::lock_guard lock{impl->mutex};
+
+    worker::Message result;
+    if (!impl->request(worker::MessageKind::Compile, name, code, result)
+        || result.kind != worker::MessageKind::Object
+        || result.param != sizeof(CompileMemoryStats) || result.payload.size() < result.param) {
+        return {};
+    }
+    std::memcpy(&impl->lastCompileStats, result.payload.data(), sizeof(CompileMemoryStats));
+    return llvm::MemoryBuffer::getMemBufferCopy(
+        std::string_view{result.payload}.substr(result.param),
+        name
+    );
+}
+CompileMemoryStats const& CompileWorker::getLastCompileStats() const {
+    return impl->lastCompileStats;
+}
+
+bool CompileWorker::generatePch(std::string_view code, std::filesystem::path const& outFile) {
+    std::lock_guard lock{impl->mutex};
+
+    auto file = outFile.u8string();
+
+    worker::Message result;
+    if (!impl->request(
+            worker::MessageKind::GeneratePch,
+            {reinterpret_cast<char const*>(file.data()), file.size()},
+            code,
+            result
+        )
+        || result.kind != worker::MessageKind::Done) {
+        return false;
+    }
+    impl->pchCode = code;
+    impl->pchFile = {reinterpret_cast<char const*>(file.data()), file.size()};
+    return true;
+}
+} // namespace lcj
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "lcj/compiler/CxxCompileLayer.h"
+
+namespace lcj {
+// Runs CxxCompileLayer in a separate LeviCppJitCompiler process, so clang's front-end and codegen
+// memory never lands in the server process. Only the finished object files are sent back.
+class CompileWorker {
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+public:
+    // a request not answered within requestTimeout kills the worker, it is restarted on demand
+    CompileWorker(
+        std::filesystem::path const& executable,
+        std::filesystem::path const& dataDir,
+        bool                         portableTarget = false,
+        std::chrono::milliseconds    requestTimeout = std::chrono::minutes{5}
+    );
+    ~CompileWorker();
+
+    // starts the worker up front so a failure shows at load, requests restart it on demand
+    bool start();
+
+    std::unique_ptr<llvm::MemoryBuffer>
+    compile(std::string_view code, std::string_view name = "main");
+
+    // measured inside the worker process
+    CompileMemoryStats const& getLastCompileStats() const;
+
+    bool generatePch(std::string_view code, std::filesystem::path const& outFile);
+};
+} // namespace lcj
@@ -1,7 +1,7 @@
 #include "CxxCompileLayer.h"
 
-#include "lcj/compiler/DiagnosticLogger.h"
-#include "lcj/core/LeviCppJit.h"
+#include "lcj/compiler/HeaderArchive.h"
+#include "lcj/utils/PathUtils.h"
 
 #include <clang/Basic/DiagnosticLex.h>
 #include <clang/Basic/DiagnosticSema.h>
@@ -11,6 +11,7 @@
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendActions.h>
 #include <clang/Lex/PreprocessorOptions.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
@@ -18,23 +19,116 @@
 #include <llvm/Support/Host.h>
 #include <llvm/Support/TargetSelect.h>
 
+#include <Windows.h>
+
+#include <Psapi.h>
+
 namespace lcj {
+// EmulatedTLS
+static constexpr std::string_view prelude{R"(#pragma once
+extern "C" {
+void                 Sleep(unsigned long dwMilliseconds);
+inline unsigned int           _tls_index         = 0;
+inline int                    _Init_global_epoch = (-2147483647i32 - 1);
+inline __declspec(thread) int _Init_thread_epoch = (-2147483647i32 - 1);
+
+inline void _Init_thread_header(volatile int* ptss) {
+    while (true) {
+        if (_InterlockedCompareExchange(reinterpret_cast<volatile long*>(ptss), -1, 0) == -1) {
+            Sleep(0);
+            continue;
+        }
+        break;
+    }
+}
+inline void _Init_thread_footer(int* ptss) {
+    *ptss = _InterlockedIncrement(reinterpret_cast<long*>(&_Init_global_epoch));
+}
+inline void _Init_thread_abort(volatile int* ptss) {
+    _InterlockedAnd(reinterpret_cast<volatile long*>(ptss), 0);
+}
+}
+#include <__msvc_all_public_headers.hpp>
+)"};
+
 struct CxxCompileLayer::Impl {
     std::unique_ptr<clang::CompilerInstance>                compilerInstance;
     llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine>      diagnosticsEngine;
     llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> inMemoryFileSystem;
+    CompileMemoryStats                                      lastCompileStats;
+
+    // Drops everything owned by the last compile. AST, Sema and the preprocessor live in bump
+    // allocators, so this releases them in bulk; the file manager and the in-memory module cache
+    // holding the pch stay warm.
+    void releaseFrontend() {
+        compilerInstance->setSema(nullptr);
+        compilerInstance->setASTConsumer(nullptr);
+        compilerInstance->setASTContext(nullptr);
+        compilerInstance->setASTReader(nullptr);
+        compilerInstance->setPreprocessor(nullptr);
+        compilerInstance->createSourceManager(compilerInstance->getFileManager());
+    }
+};
+
+class MeasuredEmitLLVMOnlyAction : public clang::EmitLLVMOnlyAction {
+    CompileMemoryStats& stats;
+
+public:
+    MeasuredEmitLLVMOnlyAction(llvm::LLVMContext* context, CompileMemoryStats& stats)
+    : EmitLLVMOnlyAction(context),
+      stats(stats) {}
+
+protected:
+    void EndSourceFileAction() override {
+        auto& ci = getCompilerInstance();
+        stats    = {};
+        if (ci.hasASTContext()) {
+            stats.astBytes = ci.getASTContext().getASTAllocatedMemory()
+                           + ci.getASTContext().getSideTableAllocatedMemory();
+        }
+        if (ci.hasPreprocessor()) {
+            stats.preprocessorBytes = ci.getPreprocessor().getTotalMemory();
+        }
+        if (ci.hasSourceManager()) {
+            stats.sourceManagerBytes = ci.getSourceManager().getContentCacheSize()
+                                     + ci.getSourceManager().getDataStructureSizes();
+        }
+        EmitLLVMOnlyAction::EndSourceFileAction();
+    }
 };
 
-CxxCompileLayer::CxxCompileLayer() : impl(std::make_unique<Impl>()) {
+static int64_t getPrivateUsage() {
+    PROCESS_MEMORY_COUNTERS_EX counters{};
+    GetProcessMemoryInfo(
+        GetCurrentProcess(),
+        reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+        sizeof(counters)
+    );
+    return static_cast<int64_t>(counters.PrivateUsage);
+}
+
+CxxCompileLayer::CxxCompileLayer(
+    std::filesystem::path const&               dataDir,
+    std::unique_ptr<clang::DiagnosticConsumer> diagnosticConsumer,
+    bool                                       portableTarget
+)
+: impl(std::make_unique<Impl>()) {
     impl->compilerInstance  = std::make_unique<clang::CompilerInstance>();
     impl->diagnosticsEngine = std::make_unique<clang::DiagnosticsEngine>(
         std::make_unique<clang::DiagnosticIDs>(),
         std::make_unique<clang::DiagnosticOptions>(),
-        new DiagnosticLogger{}
+        diagnosticConsumer.release()
     );
     impl->compilerInstance->setDiagnostics(impl->diagnosticsEngine.get());
 
-    auto overlay = std::make_unique<llvm::vfs::OverlayFileSystem>(llvm::vfs::getRealFileSystem());
+    auto headerArchive = HeaderArchiveFileSystem::open(
+        dataDir / u8"header.pak",
+        dataDir / u8"header",
+        llvm::vfs::getRealFileSystem()
+    );
+    auto overlay = std::make_unique<llvm::vfs::OverlayFileSystem>(
+        headerArchive ? headerArchive : llvm::vfs::getRealFileSystem()
+    );
 
     impl->inMemoryFileSystem = std::make_unique<llvm::vfs::InMemoryFileSystem>();
 
@@ -45,12 +139,39 @@ CxxCompileLayer::CxxCompileLayer() : impl(std::make_unique<Impl>()) {
     );
     auto& compilerInvocation = impl->compilerInstance->getInvocation();
 
-    compilerInvocation.getTargetOpts().Triple = llvm::sys::getProcessTriple();
+    auto& targetOpts  = compilerInvocation.getTargetOpts();
+    targetOpts.Triple = llvm::sys::getProcessTriple();
+    if (portableTarget) {
+        targetOpts.CPU     = "x86-64";
+        targetOpts.TuneCPU = "generic";
+    } else {
+        // same cpu and features as JITTargetMachineBuilder::detectHost, so clang vectorizes for the
+        // real hardware instead of stamping every function with the x86-64 baseline. Like the
+        // driver's -march=native, an unrecognised cpu ("generic" is not a valid clang target cpu)
+        // falls back to x86-64 and relies on the detected features alone.
+        auto hostCpu = llvm::sys::getHostCPUName();
+        if (hostCpu.empty() || hostCpu == "generic") {
+            hostCpu = "x86-64";
+        }
+        targetOpts.CPU     = hostCpu.str();
+        targetOpts.TuneCPU = targetOpts.CPU;
+        llvm::StringMap<bool> features;
+        if (llvm::sys::getHostCPUFeatures(features)) {
+            for (auto& feature : features) {
+                targetOpts.FeaturesAsWritten.push_back(
+                    (feature.second ? "+" : "-") + feature.first().str()
+                );
+            }
+        }
+    }
 
     auto& codeGenOpts           = compilerInvocation.getCodeGenOpts();
     codeGenOpts.CodeModel       = "default";
     codeGenOpts.RelocationModel = llvm::Reloc::PIC_;
     codeGenOpts.EmulatedTLS     = true;
+    // dwarf line tables let JitSymbolRegistry map addresses back to script lines
+    codeGenOpts.setDebugInfo(clang::codegenoptions::DebugLineTablesOnly);
+    codeGenOpts.DwarfVersion = 4;
 
     auto& frontendOpts = compilerInvocation.getFrontendOpts();
 
@@ -119,17 +240,26 @@ CxxCompileLayer::CxxCompileLayer() : impl(std::make_unique<Impl>()) {
     preprocessorOpts.addMacroDef("_MT");
     preprocessorOpts.addMacroDef("_DLL");
 
+    auto preludePath = pathToUtf8(dataDir / u8"lcj_prelude.h");
+    impl->inMemoryFileSystem->addFile(
+        preludePath,
+        0,
+        llvm::MemoryBuffer::getMemBuffer(prelude, preludePath)
+    );
+    preprocessorOpts.Includes.push_back(preludePath);
+
     auto& headerSearchOpts = compilerInvocation.getHeaderSearchOpts();
 
-    for (auto& header : std::filesystem::directory_iterator(
-             LeviCppJit::getInstance().getSelf().getDataDir() / u8"header"
-         )) {
-        headerSearchOpts.AddPath(
-            header.path().string(),
-            clang::frontend::IncludeDirGroup::System,
-            false,
-            false
-        );
+    std::vector<std::string> includeRoots;
+    if (headerArchive) {
+        includeRoots = headerArchive->getIncludeRoots();
+    } else {
+        for (auto& header : std::filesystem::directory_iterator(dataDir / u8"header")) {
+            includeRoots.push_back(pathToUtf8(header.path()));
+        }
+    }
+    for (auto& root : includeRoots) {
+        headerSearchOpts.AddPath(root, clang::frontend::IncludeDirGroup::System, false, false);
     }
 }
 CxxCompileLayer::~CxxCompileLayer() = default;
@@ -137,35 +267,10 @@ CxxCompileLayer::~CxxCompileLayer() = default;
 
 llvm::orc::ThreadSafeModule
 CxxCompileLayer::compileRaw(std::string_view code, std::string_view name) {
-    // EmulatedTLS
-    std::string codeBuffer{R"(
-extern "C" {
-void                 Sleep(unsigned long dwMilliseconds);
-inline unsigned int           _tls_index         = 0;
-inline int                    _Init_global_epoch = (-2147483647i32 - 1);
-inline __declspec(thread) int _Init_thread_epoch = (-2147483647i32 - 1);
-
-inline void _Init_thread_header(volatile int* ptss) {
-    while (true) {
-        if (_InterlockedCompareExchange(reinterpret_cast<volatile long*>(ptss), -1, 0) == -1) {
-            Sleep(0);
-            continue;
-        }
-        break;
-    }
-}
-inline void _Init_thread_footer(int* ptss) {
-    *ptss = _InterlockedIncrement(reinterpret_cast<long*>(&_Init_global_epoch));
-}
-inline void _Init_thread_abort(volatile int* ptss) {
-    _InterlockedAnd(reinterpret_cast<volatile long*>(ptss), 0);
-}
-}
-#include <__msvc_all_public_headers.hpp>
-)"};
-    codeBuffer += code;
+    auto usageBefore = getPrivateUsage();
 
-    auto buffer = llvm::MemoryBuffer::getMemBuffer(codeBuffer);
+    // clang needs a null terminated buffer, the prelude comes from the pch or -include
+    auto buffer = llvm::MemoryBuffer::getMemBufferCopy(code, name);
 
     auto& frontendOpts = impl->compilerInstance->getInvocation().getFrontendOpts();
 
@@ -174,18 +279,28 @@ inline void _Init_thread_abort(volatile int* ptss) {
 
     auto context = std::make_unique<llvm::LLVMContext>();
 
-    auto llvmAction = clang::EmitLLVMOnlyAction(context.get());
+    auto llvmAction = MeasuredEmitLLVMOnlyAction(context.get(), impl->lastCompileStats);
 
-    if (!impl->compilerInstance->ExecuteAction(llvmAction)) {
+    bool success = impl->compilerInstance->ExecuteAction(llvmAction);
+
+    frontendOpts.Inputs.clear();
+    impl->releaseFrontend();
+
+    impl->lastCompileStats.residentBytes = getPrivateUsage() - usageBefore;
+
+    if (!success) {
         return {};
     }
     return {llvmAction.takeModule(), std::move(context)};
 }
-void CxxCompileLayer::generatePch(std::string_view code, std::filesystem::path const& outFile) {
+CompileMemoryStats const& CxxCompileLayer::getLastCompileStats() const {
+    return impl->lastCompileStats;
+}
+bool CxxCompileLayer::generatePch(std::string_view code, std::filesystem::path const& outFile) {
     auto&       compilerInvocation = impl->compilerInstance->getInvocation();
     auto&       frontendOpts       = compilerInvocation.getFrontendOpts();
     std::string prevFile           = std::move(frontendOpts.OutputFile);
-    frontendOpts.OutputFile        = ll::string_utils::u8str2str(outFile.u8string());
+    frontendOpts.OutputFile        = pathToUtf8(outFile);
 
     auto buffer = llvm::MemoryBuffer::getMemBuffer(code);
 
@@ -198,14 +313,20 @@ void CxxCompileLayer::generatePch(std::string_view code, std::filesystem::path c
 
     auto action = clang::GeneratePCHAction{};
 
-    if (!impl->compilerInstance->ExecuteAction(action)) {
-        std::terminate();
-    }
+    bool success = impl->compilerInstance->ExecuteAction(action);
+
     // Restore the previous values:
     frontendOpts.OutputFile    = std::move(prevFile);
     frontendOpts.ProgramAction = prevAction;
 
+    frontendOpts.Inputs.clear();
+    impl->releaseFrontend();
+
+    if (!success) {
+        return false;
+    }
     auto& opts              = compilerInvocation.getPreprocessorOpts();
-    opts.ImplicitPCHInclude = ll::string_utils::u8str2str(outFile.u8string());
+    opts.ImplicitPCHInclude = pathToUtf8(outFile);
+    return true;
 }
 } // namespace lcj
@@ -1,22 +1,48 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
 #include <memory>
 #include <string_view>
-#include <filesystem>
 
 #include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 
+namespace clang {
+class DiagnosticConsumer;
+}; // namespace clang
+
 namespace lcj {
+struct CompileMemoryStats {
+    size_t  astBytes{};
+    size_t  preprocessorBytes{};
+    size_t  sourceManagerBytes{};
+    // growth of process private bytes across the compile, this includes the returned module and
+    // its LLVMContext, not just what the front-end failed to release
+    int64_t residentBytes{};
+
+    [[nodiscard]] size_t frontendPeakBytes() const {
+        return astBytes + preprocessorBytes + sourceManagerBytes;
+    }
+};
+
 class CxxCompileLayer {
     struct Impl;
     std::unique_ptr<Impl> impl;
 
 public:
-    CxxCompileLayer();
+    // portableTarget emits for the x86-64 baseline instead of the host cpu, use target_clones
+    // in scripts to still dispatch to wider instruction sets at runtime
+    CxxCompileLayer(
+        std::filesystem::path const&               dataDir,
+        std::unique_ptr<clang::DiagnosticConsumer> diagnosticConsumer,
+        bool                                       portableTarget = false
+    );
     ~CxxCompileLayer();
 
     llvm::orc::ThreadSafeModule compileRaw(std::string_view code, std::string_view name = "main");
 
-    void generatePch(std::string_view code, std::filesystem::path const& outFile);
+    CompileMemoryStats const& getLastCompileStats() const;
+
+    bool generatePch(std::string_view code, std::filesystem::path const& outFile);
 };
 } // namespace lcj
@@ -4,40 +4,45 @@
 
 namespace lcj {
 
-void DiagnosticLogger::HandleDiagnostic(
-    clang::DiagnosticsEngine::Level DiagLevel,
-    const clang::Diagnostic&        Info
-) {
-    auto        sd   = clang::StoredDiagnostic{DiagLevel, Info};
-    auto&       file = sd.getLocation();
-    std::string s;
-    if (file.hasManager()) {
-        s += file.printToString(file.getManager()) + ": ";
-    }
-
+void DiagnosticLogger::log(clang::DiagnosticsEngine::Level DiagLevel, std::string_view message) {
     auto& logger = LeviCppJit::getInstance().getLogger();
 
     switch (DiagLevel) {
     case clang::DiagnosticsEngine::Level::Ignored:
-        logger.debug("Ignored: {}{}", s, std::string_view{sd.getMessage()});
+        logger.debug("Ignored: {}", message);
         return;
     case clang::DiagnosticsEngine::Level::Note:
-        logger.info("{}{}", s, std::string_view{sd.getMessage()});
+        logger.info("{}", message);
         return;
     case clang::DiagnosticsEngine::Level::Remark:
-        logger.info("Remark: {}{}", s, std::string_view{sd.getMessage()});
+        logger.info("Remark: {}", message);
         return;
     case clang::DiagnosticsEngine::Level::Warning:
-        logger.warn("{}{}", s, std::string_view{sd.getMessage()});
+        logger.warn("{}", message);
         return;
     case clang::DiagnosticsEngine::Level::Error:
-        logger.error("{}{}", s, std::string_view{sd.getMessage()});
+        logger.error("{}", message);
         return;
     case clang::DiagnosticsEngine::Level::Fatal:
-        logger.fatal("{}{}", s, std::string_view{sd.getMessage()});
+        logger.fatal("{}", message);
         return;
     default:
         std::unreachable();
     }
 }
+
+void DiagnosticLogger::HandleDiagnostic(
+    clang::DiagnosticsEngine::Level DiagLevel,
+    const clang::Diagnostic&        Info
+) {
+    auto        sd   = clang::StoredDiagnostic{DiagLevel, Info};
+    auto&       file = sd.getLocation();
+    std::string s;
+    if (file.hasManager()) {
+        s += file.printToString(file.getManager()) + ": ";
+    }
+    s += sd.getMessage();
+
+    log(DiagLevel, s);
+}
 } // namespace lcj
\ No newline at end of file
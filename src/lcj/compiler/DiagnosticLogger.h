@@ -5,7 +5,9 @@
 namespace lcj {
 class DiagnosticLogger : public clang::DiagnosticConsumer {
 public:
+    static void log(clang::DiagnosticsEngine::Level DiagLevel, std::string_view message);
+
     void HandleDiagnostic(clang::DiagnosticsEngine::Level DiagLevel, const clang::Diagnostic& Info)
         override;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,415 @@
+#include "HeaderArchive.h"
+
+#include "lcj/utils/PathUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/xxhash.h>
+
+namespace lcj {
+
+// header | entries[fileCount] | paths | file data, each file followed by '\0'
+static constexpr char     archiveMagic[8] = {'L', 'C', 'J', 'H', 'P', 'A', 'K', '\0'};
+static constexpr uint32_t archiveVersion  = 2;
+static constexpr uint64_t archiveDevice   = 0x4c434a48; // "LCJH"
+
+struct ArchiveHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t fileCount;
+    int64_t  modificationTime;
+    uint64_t sourceFingerprint;
+};
+
+struct ArchiveEntry {
+    uint64_t pathOffset;
+    uint64_t pathSize;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+static std::string normalizePath(llvm::StringRef path) {
+    llvm::SmallString<256> str{path};
+    std::replace(str.begin(), str.end(), '\\', '/');
+    llvm::sys::path::remove_dots(str, true, llvm::sys::path::Style::posix);
+    return str.str().lower();
+}
+
+struct SourceFile {
+    std::string           key;
+    std::filesystem::path path;
+    uint64_t              size;
+    int64_t               writeTime;
+};
+
+static bool collectSources(std::filesystem::path const& root, std::vector<SourceFile>& sources) {
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator iter{root, ec}, end; !ec && iter != end;
+         iter.increment(ec)) {
+        if (!iter->is_regular_file(ec)) {
+            continue;
+        }
+        auto size      = iter->file_size(ec);
+        auto writeTime = iter->last_write_time(ec);
+        if (ec) {
+            return false;
+        }
+        sources.push_back(
+            {normalizePath(pathToUtf8(iter->path().lexically_relative(root))),
+             iter->path(),
+             size,
+             writeTime.time_since_epoch().count()}
+        );
+    }
+    if (ec) {
+        return false;
+    }
+    std::sort(sources.begin(), sources.end(), [](auto& a, auto& b) { return a.key < b.key; });
+    // the windows file system is case insensitive, the first spelling wins
+    sources.erase(
+        std::unique(
+            sources.begin(),
+            sources.end(),
+            [](auto& a, auto& b) { return a.key == b.key; }
+        ),
+        sources.end()
+    );
+    return true;
+}
+
+// changes whenever a header is added, removed, resized or rewritten
+static uint64_t fingerprintOf(std::vector<SourceFile> const& sources) {
+    std::string data;
+    for (auto& source : sources) {
+        data.append(source.key);
+        data.push_back('\0');
+        data.append(reinterpret_cast<char const*>(&source.size), sizeof(source.size));
+        data.append(reinterpret_cast<char const*>(&source.writeTime), sizeof(source.writeTime));
+    }
+    return llvm::xxHash64(data);
+}
+
+class ArchiveFile : public llvm::vfs::File {
+    llvm::vfs::Status stat;
+    llvm::StringRef   data;
+
+public:
+    ArchiveFile(llvm::vfs::Status stat, llvm::StringRef data) : stat(std::move(stat)), data(data) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override { return stat; }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+    getBuffer(llvm::Twine const& name, int64_t, bool requiresNullTerminator, bool) override {
+        return llvm::MemoryBuffer::getMemBuffer(data, name.str(), requiresNullTerminator);
+    }
+
+    std::error_code close() override { return {}; }
+};
+
+class ArchiveDirIterImpl : public llvm::vfs::detail::DirIterImpl {
+    std::vector<llvm::vfs::directory_entry> entries;
+    size_t                                  index{};
+
+public:
+    explicit ArchiveDirIterImpl(std::vector<llvm::vfs::directory_entry> entries)
+    : entries(std::move(entries)) {
+        if (!this->entries.empty()) {
+            CurrentEntry = this->entries.front();
+        }
+    }
+
+    std::error_code increment() override {
+        CurrentEntry = ++index < entries.size() ? entries[index] : llvm::vfs::directory_entry{};
+        return {};
+    }
+};
+
+HeaderArchiveFileSystem::HeaderArchiveFileSystem(
+    std::unique_ptr<llvm::MemoryBuffer>             archive,
+    std::string                                     mountPoint,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base
+)
+: ProxyFileSystem(std::move(base)),
+  archive(std::move(archive)),
+  mountPoint(normalizePath(mountPoint)) {
+    auto  data    = this->archive->getBufferStart();
+    auto& header  = *reinterpret_cast<ArchiveHeader const*>(data);
+    auto* entries = reinterpret_cast<ArchiveEntry const*>(data + sizeof(ArchiveHeader));
+
+    modificationTime = llvm::sys::toTimePoint(header.modificationTime);
+
+    uint32_t nextId = header.fileCount + 1;
+
+    directories[""].id = nextId++;
+    for (uint32_t i = 0; i < header.fileCount; i++) {
+        llvm::StringRef child{data + entries[i].pathOffset, entries[i].pathSize};
+        files[child] = i;
+        for (;;) {
+            auto pos    = child.rfind('/');
+            auto parent = pos == llvm::StringRef::npos ? llvm::StringRef{} : child.substr(0, pos);
+
+            auto [iter, inserted] = directories.try_emplace(parent);
+            iter->second.children.push_back(child);
+            if (!inserted) {
+                break;
+            }
+            iter->second.id = nextId++;
+            child           = parent;
+        }
+    }
+}
+
+bool HeaderArchiveFileSystem::pack(
+    std::filesystem::path const& root,
+    std::filesystem::path const& outFile
+) {
+    std::vector<SourceFile> sources;
+    if (!collectSources(root, sources)) {
+        return false;
+    }
+
+    ArchiveHeader header{};
+    std::memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+    header.version           = archiveVersion;
+    header.fileCount         = static_cast<uint32_t>(sources.size());
+    header.modificationTime  = llvm::sys::toTimeT(std::chrono::system_clock::now());
+    header.sourceFingerprint = fingerprintOf(sources);
+
+    std::vector<ArchiveEntry> entries(sources.size());
+
+    uint64_t offset = sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry);
+    for (size_t i = 0; i < sources.size(); i++) {
+        entries[i].pathOffset  = offset;
+        entries[i].pathSize    = sources[i].key.size();
+        offset                += sources[i].key.size();
+    }
+
+    auto tempFile = std::filesystem::path{outFile} += u8".tmp";
+    bool written  = true;
+    {
+        std::ofstream out{tempFile, std::ios::binary | std::ios::trunc};
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(
+            reinterpret_cast<char const*>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(ArchiveEntry))
+        );
+        for (auto& source : sources) {
+            out.write(source.key.data(), static_cast<std::streamsize>(source.key.size()));
+        }
+        for (size_t i = 0; i < sources.size() && written; i++) {
+            std::ifstream in{sources[i].path, std::ios::binary};
+            std::string   content;
+            if (in) {
+                content.assign(std::istreambuf_iterator<char>{in}, {});
+            }
+            if (!in.is_open() || in.bad()) {
+                // a header that vanished or can't be read would be packed as an empty file
+                written = false;
+                break;
+            }
+
+            entries[i].dataOffset  = offset;
+            entries[i].dataSize    = content.size();
+            offset                += content.size() + 1;
+
+            out.write(content.data(), static_cast<std::streamsize>(content.size() + 1));
+        }
+        out.seekp(sizeof(ArchiveHeader));
+        out.write(
+            reinterpret_cast<char const*>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(ArchiveEntry))
+        );
+        out.close();
+        written = written && !out.fail();
+    }
+    std::error_code ec;
+    if (written) {
+        std::filesystem::rename(tempFile, outFile, ec);
+    }
+    if (!written || ec) {
+        // never leave a half-written archive behind for the next start to trip over
+        std::filesystem::remove(tempFile, ec);
+        return false;
+    }
+    return true;
+}
+
+bool HeaderArchiveFileSystem::isUpToDate(
+    std::filesystem::path const& archiveFile,
+    std::filesystem::path const& root
+) {
+    ArchiveHeader header{};
+    {
+        std::ifstream in{archiveFile, std::ios::binary};
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+    }
+    if (std::memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) != 0
+        || header.version != archiveVersion) {
+        return false;
+    }
+    std::vector<SourceFile> sources;
+    return collectSources(root, sources) && fingerprintOf(sources) == header.sourceFingerprint;
+}
+
+llvm::IntrusiveRefCntPtr<HeaderArchiveFileSystem> HeaderArchiveFileSystem::open(
+    std::filesystem::path const&                    archiveFile,
+    std::filesystem::path const&                    mountPoint,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base
+) {
+    auto buffer = llvm::MemoryBuffer::getFile(pathToUtf8(archiveFile), false, false);
+    if (!buffer) {
+        return nullptr;
+    }
+    auto data = (*buffer)->getBuffer();
+    if (data.size() < sizeof(ArchiveHeader)) {
+        return nullptr;
+    }
+    auto& header     = *reinterpret_cast<ArchiveHeader const*>(data.data());
+    auto  headerSize = sizeof(ArchiveHeader) + uint64_t{header.fileCount} * sizeof(ArchiveEntry);
+    if (std::memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) != 0
+        || header.version != archiveVersion || data.size() < headerSize) {
+        return nullptr;
+    }
+    auto* entries = reinterpret_cast<ArchiveEntry const*>(data.data() + sizeof(ArchiveHeader));
+    for (uint32_t i = 0; i < header.fileCount; i++) {
+        if (entries[i].pathOffset + entries[i].pathSize > data.size()
+            || entries[i].dataOffset + entries[i].dataSize >= data.size()) {
+            return nullptr;
+        }
+    }
+    return llvm::makeIntrusiveRefCnt<HeaderArchiveFileSystem>(
+        std::move(*buffer),
+        pathToUtf8(mountPoint),
+        std::move(base)
+    );
+}
+
+std::vector<std::string> HeaderArchiveFileSystem::getIncludeRoots() const {
+    std::vector<std::string> res;
+    for (auto child : directories.find("")->second.children) {
+        if (directories.count(child)) {
+            res.push_back(mountPoint + "/" + child.str());
+        }
+    }
+    return res;
+}
+
+std::optional<std::string> HeaderArchiveFileSystem::getKey(llvm::Twine const& path) const {
+    llvm::SmallString<256> str;
+    path.toVector(str);
+    if (!llvm::sys::path::is_absolute(str)) {
+        return std::nullopt;
+    }
+    auto key = normalizePath(str);
+    if (key == mountPoint) {
+        return std::string{};
+    }
+    if (key.size() <= mountPoint.size() || key[mountPoint.size()] != '/'
+        || !llvm::StringRef{key}.startswith(mountPoint)) {
+        return std::nullopt;
+    }
+    return key.substr(mountPoint.size() + 1);
+}
+
+llvm::vfs::Status
+HeaderArchiveFileSystem::makeStatus(llvm::Twine const& path, llvm::StringRef key) const {
+    if (auto file = files.find(key); file != files.end()) {
+        auto& entry = reinterpret_cast<ArchiveEntry const*>(
+            archive->getBufferStart() + sizeof(ArchiveHeader)
+        )[file->second];
+        return {
+            path,
+            llvm::sys::fs::UniqueID{archiveDevice, file->second + 1ull},
+            modificationTime,
+            0,
+            0,
+            entry.dataSize,
+            llvm::sys::fs::file_type::regular_file,
+            llvm::sys::fs::perms::all_read
+        };
+    }
+    return {
+        path,
+        llvm::sys::fs::UniqueID{archiveDevice, directories.find(key)->second.id},
+        modificationTime,
+        0,
+        0,
+        0,
+        llvm::sys::fs::file_type::directory_file,
+        llvm::sys::fs::perms::all_read | llvm::sys::fs::perms::all_exe
+    };
+}
+
+llvm::ErrorOr<llvm::vfs::Status> HeaderArchiveFileSystem::status(llvm::Twine const& path) {
+    auto key = getKey(path);
+    if (!key) {
+        return ProxyFileSystem::status(path);
+    }
+    if (!files.count(*key) && !directories.count(*key)) {
+        return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+    return makeStatus(path, *key);
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+HeaderArchiveFileSystem::openFileForRead(llvm::Twine const& path) {
+    auto key = getKey(path);
+    if (!key) {
+        return ProxyFileSystem::openFileForRead(path);
+    }
+    auto file = files.find(*key);
+    if (file == files.end()) {
+        return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+    auto& entry = reinterpret_cast<ArchiveEntry const*>(
+        archive->getBufferStart() + sizeof(ArchiveHeader)
+    )[file->second];
+    return std::make_unique<ArchiveFile>(
+        makeStatus(path, *key),
+        llvm::StringRef{archive->getBufferStart() + entry.dataOffset, entry.dataSize}
+    );
+}
+
+llvm::vfs::directory_iterator
+HeaderArchiveFileSystem::dir_begin(llvm::Twine const& dir, std::error_code& ec) {
+    auto key = getKey(dir);
+    if (!key) {
+        return ProxyFileSystem::dir_begin(dir, ec);
+    }
+    auto directory = directories.find(*key);
+    if (directory == directories.end()) {
+        ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        return {};
+    }
+    auto prefix = dir.str();
+
+    std::vector<llvm::vfs::directory_entry> entries;
+    for (auto child : directory->second.children) {
+        entries.emplace_back(
+            prefix + "/" + child.substr(child.rfind('/') + 1).str(),
+            files.count(child) ? llvm::sys::fs::file_type::regular_file
+                                  : llvm::sys::fs::file_type::directory_file
+        );
+    }
+    return llvm::vfs::directory_iterator{std::make_shared<ArchiveDirIterImpl>(std::move(entries))};
+}
+
+std::error_code HeaderArchiveFileSystem::getRealPath(
+    llvm::Twine const&           path,
+    llvm::SmallVectorImpl<char>& output
+) const {
+    auto key = getKey(path);
+    if (!key) {
+        return ProxyFileSystem::getRealPath(path, output);
+    }
+    auto real = key->empty() ? mountPoint : mountPoint + "/" + *key;
+    output.assign(real.begin(), real.end());
+    return {};
+}
+} // namespace lcj
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+namespace lcj {
+// Serves everything below mountPoint from a single memory mapped archive built by pack(), so
+// header lookups across the many include dirs are hash lookups instead of stat calls. Other
+// paths fall through to the underlying file system.
+class HeaderArchiveFileSystem : public llvm::vfs::ProxyFileSystem {
+    struct Directory {
+        uint32_t                     id{};
+        std::vector<llvm::StringRef> children;
+    };
+
+    std::unique_ptr<llvm::MemoryBuffer> archive;
+    std::string                         mountPoint;
+    llvm::sys::TimePoint<>              modificationTime;
+    llvm::StringMap<uint32_t>           files;
+    llvm::StringMap<Directory>          directories;
+
+    std::optional<std::string> getKey(llvm::Twine const& path) const;
+
+    llvm::vfs::Status makeStatus(llvm::Twine const& path, llvm::StringRef key) const;
+
+public:
+    HeaderArchiveFileSystem(
+        std::unique_ptr<llvm::MemoryBuffer>             archive,
+        std::string                                     mountPoint,
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base
+    );
+
+    // packs all files below root, paths are stored lower-cased like the windows file system
+    static bool pack(std::filesystem::path const& root, std::filesystem::path const& outFile);
+
+    // whether the archive was packed from the current contents of root
+    static bool
+    isUpToDate(std::filesystem::path const& archiveFile, std::filesystem::path const& root);
+
+    static llvm::IntrusiveRefCntPtr<HeaderArchiveFileSystem> open(
+        std::filesystem::path const&                    archiveFile,
+        std::filesystem::path const&                    mountPoint,
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base
+    );
+
+    // the top level directories, each of them is an include root
+    std::vector<std::string> getIncludeRoots() const;
+
+    llvm::ErrorOr<llvm::vfs::Status> status(llvm::Twine const& path) override;
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(llvm::Twine const& path) override;
+
+    llvm::vfs::directory_iterator dir_begin(llvm::Twine const& dir, std::error_code& ec) override;
+
+    std::error_code
+    getRealPath(llvm::Twine const& path, llvm::SmallVectorImpl<char>& output) const override;
+};
+} // namespace lcj
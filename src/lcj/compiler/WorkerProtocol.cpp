@@ -0,0 +1,77 @@
+#include "WorkerProtocol.h"
+
+#include <algorithm>
+
+#include <Windows.h>
+
+namespace lcj::worker {
+
+struct MessageHeader {
+    MessageKind kind;
+    uint32_t    param;
+    uint64_t    size;
+};
+
+static bool readBytes(void* handle, void* data, size_t size) {
+    auto* ptr = static_cast<char*>(data);
+    while (size > 0) {
+        DWORD read = 0;
+        if (!ReadFile(
+                handle,
+                ptr,
+                static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)),
+                &read,
+                nullptr
+            )
+            || read == 0) {
+            return false;
+        }
+        ptr  += read;
+        size -= read;
+    }
+    return true;
+}
+
+static bool writeBytes(void* handle, void const* data, size_t size) {
+    auto* ptr = static_cast<char const*>(data);
+    while (size > 0) {
+        DWORD written = 0;
+        if (!WriteFile(
+                handle,
+                ptr,
+                static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)),
+                &written,
+                nullptr
+            )) {
+            return false;
+        }
+        ptr  += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool Channel::read(Message& message) {
+    MessageHeader header;
+    if (!readBytes(input, &header, sizeof(header))) {
+        return false;
+    }
+    message.kind  = header.kind;
+    message.param = header.param;
+    message.payload.resize(header.size);
+    return readBytes(input, message.payload.data(), message.payload.size());
+}
+
+bool Channel::write(MessageKind kind, uint32_t param, std::string_view payload) {
+    MessageHeader header{kind, param, payload.size()};
+    return writeBytes(output, &header, sizeof(header))
+        && writeBytes(output, payload.data(), payload.size());
+}
+
+bool Channel::write(MessageKind kind, std::string_view prefix, std::string_view payload) {
+    MessageHeader header{kind, static_cast<uint32_t>(prefix.size()), prefix.size() + payload.size()};
+    return writeBytes(output, &header, sizeof(header))
+        && writeBytes(output, prefix.data(), prefix.size())
+        && writeBytes(output, payload.data(), payload.size());
+}
+} // namespace lcj::worker
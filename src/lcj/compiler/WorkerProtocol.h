@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace lcj::worker {
+
+enum class MessageKind : uint32_t {
+    // server -> worker
+    Compile,
+    GeneratePch,
+    Shutdown,
+    // worker -> server
+    Diagnostic,
+    Object,
+    Done,
+    Failed,
+};
+
+// Compile:     param = size of the module name prefix in payload, payload = name + code
+// GeneratePch: param = size of the output path prefix in payload, payload = path + code
+// Diagnostic:  param = clang::DiagnosticsEngine::Level,           payload = message
+// Object:      param = size of the CompileMemoryStats prefix in payload, payload = stats + object
+struct Message {
+    MessageKind kind{};
+    uint32_t    param{};
+    std::string payload;
+};
+
+class Channel {
+    void* input;
+    void* output;
+
+public:
+    Channel(void* input, void* output) : input(input), output(output) {}
+
+    bool read(Message& message);
+
+    bool write(MessageKind kind, uint32_t param = 0, std::string_view payload = {});
+
+    bool write(MessageKind kind, std::string_view prefix, std::string_view payload);
+};
+} // namespace lcj::worker
@@ -0,0 +1,24 @@
+#pragma once
+
+namespace lcj {
+
+struct Config {
+    int version = 1;
+
+    // compile scripts in a separate LeviCppJitCompiler process, only objects are linked in-process
+    bool outOfProcessCompile = false;
+
+    // a compile worker that does not answer a request in time is killed and restarted
+    int compileTimeoutSeconds = 300;
+
+    // write every jitted function to data/perf/perf-<pid>.map for native profilers
+    bool writePerfMap = false;
+
+    // emit scripts for the x86-64 baseline instead of the host cpu
+    bool portableCodegen = false;
+
+    // serve data/header from data/header.pak, repacked on load whenever data/header changed
+    bool packHeaders = true;
+};
+
+} // namespace lcj
@@ -1,24 +1,71 @@
 #include "LeviCppJit.h"
 
+#include "lcj/compiler/CompileWorker.h"
 #include "lcj/compiler/CxxCompileLayer.h"
+#include "lcj/compiler/DiagnosticLogger.h"
+#include "lcj/compiler/HeaderArchive.h"
 #include "lcj/engine/LazyJitEngine.h"
+#include "lcj/runtime/TickScheduler.h"
 #include "lcj/utils/LogOnError.h"
 
 #include <llvm/Support/ManagedStatic.h>
 #include <llvm/Support/TargetSelect.h>
 
+#include <ll/api/Config.h>
 #include <ll/api/plugin/NativePlugin.h>
 #include <ll/api/plugin/RegisterHelper.h>
+#include <ll/api/schedule/Scheduler.h>
+#include <ll/api/schedule/Task.h>
 #include <ll/api/utils/WinUtils.h>
 #include <magic_enum.hpp>
 
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
 namespace lcj {
 void registerTestCommand();
+
+static size_t getBackgroundThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency() / 4);
+}
+
 struct LeviCppJit::Impl {
-    CxxCompileLayer cxxCompileLayer;
-    LazyJitEngine   jitEngine;
+    TickScheduler                    scheduler{getBackgroundThreadCount()};
+    ll::schedule::GameTickScheduler  tickScheduler;
+    std::unique_ptr<CxxCompileLayer> cxxCompileLayer;
+    std::unique_ptr<CompileWorker>   compileWorker;
+    LazyJitEngine                    jitEngine;
+
+    // dylibs whose scripts still have suspended tasks, released once those finished
+    std::mutex         parkedMutex;
+    std::vector<Dylib> parkedDylibs;
+
+    void tick() {
+        scheduler.tick();
+        {
+            std::lock_guard lock{parkedMutex};
+            std::erase_if(parkedDylibs, [](Dylib& lib) { return !lib.hasPendingTasks(); });
+        }
+        jitEngine.processDroppedDylibs();
+    }
 };
 
+static std::filesystem::path getWorkerExecutable() {
+    HMODULE self{};
+    GetModuleHandleExW(
+        GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        reinterpret_cast<LPCWSTR>(&getWorkerExecutable),
+        &self
+    );
+    std::wstring path(MAX_PATH, L'\0');
+    path.resize(GetModuleFileNameW(self, path.data(), static_cast<DWORD>(path.size())));
+    return std::filesystem::path{path}.parent_path() / u8"LeviCppJitCompiler.exe";
+}
+
 LeviCppJit::LeviCppJit(ll::plugin::NativePlugin& p) : mSelf(p) {}
 LeviCppJit::~LeviCppJit() = default;
 
@@ -29,13 +76,63 @@ LeviCppJit& LeviCppJit::getInstance() { return *instance; }
 ll::plugin::NativePlugin& LeviCppJit::getSelf() const { return mSelf; }
 
 bool LeviCppJit::load() {
+    auto configPath = getSelf().getConfigDir() / u8"config.json";
+    if (!ll::config::loadConfig(mConfig, configPath)) {
+        getLogger().warn("Cannot load configurations from {}, saving defaults", configPath);
+        if (!ll::config::saveConfig(mConfig, configPath)) {
+            getLogger().error("Cannot save default configurations to {}", configPath);
+        }
+    }
+    if (mConfig.compileTimeoutSeconds <= 0) {
+        // the worker's watchdog would fire at once or at an absolute time
+        getLogger().warn(
+            "compileTimeoutSeconds must be positive, got {}, using {}",
+            mConfig.compileTimeoutSeconds,
+            Config{}.compileTimeoutSeconds
+        );
+        mConfig.compileTimeoutSeconds = Config{}.compileTimeoutSeconds;
+    }
+
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
 
     mImpl = std::make_unique<Impl>();
 
-    mImpl->cxxCompileLayer.generatePch(
-        R"(
+    // the compile layers serve header.pak whenever it exists, so a stale one must not survive
+    auto headerDir = getDataDir() / u8"header";
+    auto archive   = getDataDir() / u8"header.pak";
+    if (!mConfig.packHeaders || !HeaderArchiveFileSystem::isUpToDate(archive, headerDir)) {
+        std::error_code ec;
+        std::filesystem::remove(archive, ec);
+        if (mConfig.packHeaders) {
+            if (HeaderArchiveFileSystem::pack(headerDir, archive)) {
+                getLogger().info("Packed headers into {}", archive);
+            } else {
+                getLogger().warn("Cannot pack headers into {}, reading them from disk", archive);
+            }
+        }
+    }
+
+    if (mConfig.outOfProcessCompile) {
+        mImpl->compileWorker = std::make_unique<CompileWorker>(
+            getWorkerExecutable(),
+            getDataDir(),
+            mConfig.portableCodegen,
+            std::chrono::seconds{mConfig.compileTimeoutSeconds}
+        );
+        if (!mImpl->compileWorker->start()) {
+            getLogger().error("Failed to start compile worker");
+            return false;
+        }
+    } else {
+        mImpl->cxxCompileLayer = std::make_unique<CxxCompileLayer>(
+            getDataDir(),
+            std::make_unique<DiagnosticLogger>(),
+            mConfig.portableCodegen
+        );
+    }
+
+    constexpr std::string_view pch{R"(
 #include <__msvc_all_public_headers.hpp>
 #define LL_MEMORY_OPERATORS
 namespace std
@@ -43,10 +140,17 @@ namespace std
     enum class align_val_t : size_t {};
 }
 #include "ll/api/memory/MemoryOperators.h" // IWYU pragma: keep
-    )",
-        getDataDir() / u8"pch"
-    );
-
+#include <lcj/Callback.h>
+#include <lcj/Coroutine.h>
+    )"};
+
+    bool pchGenerated = mImpl->compileWorker
+                          ? mImpl->compileWorker->generatePch(pch, getDataDir() / u8"pch")
+                          : mImpl->cxxCompileLayer->generatePch(pch, getDataDir() / u8"pch");
+    if (!pchGenerated) {
+        getLogger().error("Failed to generate pch");
+        return false;
+    }
     return true;
 }
 bool LeviCppJit::unload() {
@@ -56,8 +160,7 @@ bool LeviCppJit::unload() {
 }
 
 std::string LeviCppJit::simpleEval(std::string_view code) {
-    auto module = mImpl->cxxCompileLayer.compileRaw(
-        std::string(R"(
+    auto source = std::string(R"(
 #line 1
 decltype(auto) evalImpl(){
     )")
@@ -77,26 +180,63 @@ std::any evalImpl2() {
 std::any eval() {
     return evalImpl2<evalImpl>();
 }
-)",
-        "<eval>"
-    );
+)";
+    std::unique_ptr<llvm::MemoryBuffer> object;
+    llvm::orc::ThreadSafeModule         module;
+    CompileMemoryStats const*           stats{};
+    if (mImpl->compileWorker) {
+        object = mImpl->compileWorker->compile(source, "<eval>");
+        stats  = &mImpl->compileWorker->getLastCompileStats();
+    } else {
+        module = mImpl->cxxCompileLayer->compileRaw(source, "<eval>");
+        stats  = &mImpl->cxxCompileLayer->getLastCompileStats();
+    }
+    if (object || module) {
+        getLogger().debug(
+            "Compile memory: front-end peak {} KiB, resident with module {} KiB",
+            stats->frontendPeakBytes() / 1024,
+            stats->residentBytes / 1024
+        );
+    }
     std::string res;
-    if (module) {
+    if (object || module) {
         auto lib = mImpl->jitEngine.createDylib("<eval>");
-        lib.addModule(std::move(module));
+        if (object) {
+            lib.addObject(std::move(object));
+        } else {
+            lib.addModule(std::move(module));
+        }
         lib.initialize();
-        res = lib.lookup<std::any()>("?eval@@YA?AVany@std@@XZ")().type().name();
-        lib.deinitialize();
+        {
+            auto guard = lib.enter();
+            res        = lib.lookup<"eval", std::any()>()().type().name();
+        }
+        if (lib.hasPendingTasks()) {
+            std::lock_guard lock{mImpl->parkedMutex};
+            mImpl->parkedDylibs.push_back(std::move(lib));
+        }
     }
     return res;
 }
 
+std::optional<JitSymbolInfo> LeviCppJit::findJitSymbol(void const* address) const {
+    return mImpl->jitEngine.findSymbol(address);
+}
+
+TickScheduler& LeviCppJit::getScheduler() { return mImpl->scheduler; }
+
 bool LeviCppJit::enable() {
     registerTestCommand();
+    mImpl->tickScheduler.add<ll::schedule::RepeatTask>(ll::chrono::ticks{1}, [this] {
+        mImpl->tick();
+    });
     return true;
 }
 
-bool LeviCppJit::disable() { return true; }
+bool LeviCppJit::disable() {
+    mImpl->tickScheduler.clear();
+    return true;
+}
 
 
 } // namespace lcj
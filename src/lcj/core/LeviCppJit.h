@@ -1,10 +1,15 @@
 #pragma once
 
 #include <any>
+#include <optional>
+
+#include "lcj/core/Config.h"
+#include "lcj/engine/JitSymbolInfo.h"
 
 #include <ll/api/plugin/NativePlugin.h>
 
 namespace lcj {
+class TickScheduler;
 
 class LeviCppJit {
 public:
@@ -24,8 +29,14 @@ class LeviCppJit {
     [[nodiscard]] decltype(auto) getLogger() const { return (getSelf().getLogger()); }
     [[nodiscard]] decltype(auto) getDataDir() const { return (getSelf().getDataDir()); }
 
+    [[nodiscard]] Config const& getConfig() const { return mConfig; }
+
     std::string simpleEval(std::string_view code);
 
+    std::optional<JitSymbolInfo> findJitSymbol(void const* address) const;
+
+    TickScheduler& getScheduler();
+
     bool load();
 
     bool enable();
@@ -36,6 +47,7 @@ class LeviCppJit {
 
 private:
     ll::plugin::NativePlugin& mSelf;
+    Config                    mConfig;
     struct Impl;
     std::unique_ptr<Impl> mImpl;
 };
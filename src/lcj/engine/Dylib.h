@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <span>
 #include <string_view>
+#include <vector>
+
+#include "lcj/utils/MsvcMangle.h"
 
 #include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/MemoryBuffer.h>
 
 namespace llvm::orc {
 class JITDylib;
@@ -11,15 +17,36 @@ class LLJIT;
 }; // namespace llvm::orc
 
 namespace lcj {
+class DylibReclaimer;
+
 class Dylib {
+    friend DylibReclaimer;
 
     struct Impl;
     std::unique_ptr<Impl> impl;
 
+    void release();
+
     void* lookupImpl(std::string_view name);
 
+    std::vector<void*> lookupBatchImpl(std::span<std::string_view const> names);
+
 public:
-    Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit);
+    // Keeps the dylib from being reclaimed while its code runs on this thread. Every entry into
+    // script code must hold one: host calls through enter(), callbacks the script hands to the
+    // game through lcj::guarded from script/lcj/Callback.h. Coroutines are tracked by the
+    // TickScheduler instead.
+    class [[nodiscard]] CallGuard {
+        std::atomic<size_t>* activeCalls;
+
+    public:
+        explicit CallGuard(std::atomic<size_t>& activeCalls);
+        CallGuard(CallGuard&&) noexcept;
+        CallGuard& operator=(CallGuard&&) = delete;
+        ~CallGuard();
+    };
+
+    Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit, DylibReclaimer& reclaimer);
 
     Dylib(Dylib&&) noexcept;
     Dylib& operator=(Dylib&&) noexcept;
@@ -27,15 +54,34 @@ class Dylib {
     Dylib(Dylib const&)            = delete;
     Dylib& operator=(Dylib const&) = delete;
 
+    // deinitialized on a later server tick, then removed by the engine's background reclaimer
     ~Dylib();
     void initialize();
     void deinitialize();
 
     void addModule(llvm::orc::ThreadSafeModule&& module);
 
+    void addObject(std::unique_ptr<llvm::MemoryBuffer>&& object);
+
+    // whether coroutines of this dylib are still suspended in the TickScheduler
+    [[nodiscard]] bool hasPendingTasks() const;
+
+    CallGuard enter();
+
     template <class T>
     T* lookup(std::string_view name) {
         return reinterpret_cast<T*>(lookupImpl(name));
     }
+
+    // looks up a free function by its qualified C++ name, e.g. lookup<"ns::f", int(int)>()
+    template <FixedString Name, class T>
+    T* lookup() {
+        return lookup<T>(msvc_mangle::functionName<Name, T>);
+    }
+
+    // resolves all names in one session query, missing symbols are returned as nullptr
+    std::vector<void*> lookupBatch(std::span<std::string_view const> names) {
+        return lookupBatchImpl(names);
+    }
 };
 } // namespace lcj
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace lcj {
+
+struct JitSymbolInfo {
+    std::string name;
+    uint64_t    address{};
+    uint64_t    size{};
+    std::string file;
+    uint32_t    line{};
+};
+
+} // namespace lcj
@@ -0,0 +1,120 @@
+#include "JitSymbolRegistry.h"
+
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/Demangle/Demangle.h>
+#include <llvm/Object/SymbolSize.h>
+
+#include <Windows.h>
+
+namespace lcj {
+
+JitSymbolRegistry::JitSymbolRegistry(std::filesystem::path const& perfMapDir) {
+    if (perfMapDir.empty()) {
+        return;
+    }
+    std::filesystem::create_directories(perfMapDir);
+    perfMap.open(perfMapDir / ("perf-" + std::to_string(GetCurrentProcessId()) + ".map"));
+}
+
+void JitSymbolRegistry::notifyObjectLoaded(
+    ObjectKey                                  K,
+    llvm::object::ObjectFile const&            Obj,
+    llvm::RuntimeDyld::LoadedObjectInfo const& L
+) {
+    auto symbols = llvm::object::computeSymbolSizes(Obj);
+    if (!symbols) {
+        llvm::consumeError(symbols.takeError());
+        return;
+    }
+    // line tables are only available when the module carries dwarf
+    auto context = llvm::DWARFContext::create(
+        Obj,
+        llvm::DWARFContext::ProcessDebugRelocations::Process,
+        &L
+    );
+
+    std::unique_lock lock{mutex};
+
+    auto& loaded = objects[K];
+    for (auto& [sym, size] : *symbols) {
+        auto type = sym.getType();
+        if (!type || *type != llvm::object::SymbolRef::ST_Function || size == 0) {
+            llvm::consumeError(type.takeError());
+            continue;
+        }
+        auto name    = sym.getName();
+        auto address = sym.getAddress();
+        auto section = sym.getSection();
+        if (!name || !address || !section || *section == Obj.section_end()) {
+            llvm::consumeError(name.takeError());
+            llvm::consumeError(address.takeError());
+            llvm::consumeError(section.takeError());
+            continue;
+        }
+        uint64_t loadAddress = L.getSectionLoadAddress(**section);
+        if (loadAddress == 0) {
+            continue;
+        }
+        uint64_t start = loadAddress + (*address - (*section)->getAddress());
+
+        FunctionEntry entry{llvm::demangle(name->str()), size, {}};
+
+        // the context relocated the line tables to load addresses
+        for (auto& [lineAddress, info] : context->getLineInfoForAddressRange(
+                 {start, (*section)->getIndex()},
+                 size,
+                 llvm::DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath
+             )) {
+            entry.lines.emplace_back(lineAddress - start, info.Line, info.FileName);
+        }
+
+        if (perfMap.is_open()) {
+            perfMap << std::hex << start << ' ' << size << std::dec << ' ' << entry.name << '\n';
+        }
+        functions.insert_or_assign(start, std::move(entry));
+        loaded.push_back(start);
+    }
+    if (perfMap.is_open()) {
+        perfMap.flush();
+    }
+}
+
+void JitSymbolRegistry::notifyFreeingObject(ObjectKey K) {
+    std::unique_lock lock{mutex};
+
+    auto iter = objects.find(K);
+    if (iter == objects.end()) {
+        return;
+    }
+    for (auto start : iter->second) {
+        functions.erase(start);
+    }
+    objects.erase(iter);
+}
+
+std::optional<JitSymbolInfo> JitSymbolRegistry::findSymbol(void const* address) const {
+    auto addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(address));
+
+    std::shared_lock lock{mutex};
+
+    auto iter = functions.upper_bound(addr);
+    if (iter == functions.begin()) {
+        return std::nullopt;
+    }
+    --iter;
+    auto& [start, entry] = *iter;
+    if (addr >= start + entry.size) {
+        return std::nullopt;
+    }
+    JitSymbolInfo res{entry.name, start, entry.size};
+    for (auto& line : entry.lines) {
+        if (start + line.offset > addr) {
+            break;
+        }
+        res.file = line.file;
+        res.line = line.line;
+    }
+    return res;
+}
+
+} // namespace lcj
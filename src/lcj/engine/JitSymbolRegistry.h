@@ -0,0 +1,51 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "lcj/engine/JitSymbolInfo.h"
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+
+namespace lcj {
+
+// Records every function emitted by the jit, so native profilers and crash handlers can map
+// addresses back to script functions. Optionally mirrors them into a perf-<pid>.map file.
+class JitSymbolRegistry : public llvm::JITEventListener {
+    struct LineEntry {
+        uint64_t    offset;
+        uint32_t    line;
+        std::string file;
+    };
+    struct FunctionEntry {
+        std::string            name;
+        uint64_t               size;
+        std::vector<LineEntry> lines;
+    };
+
+    mutable std::shared_mutex                  mutex;
+    std::map<uint64_t, FunctionEntry>          functions;
+    std::map<ObjectKey, std::vector<uint64_t>> objects;
+    std::ofstream                              perfMap;
+
+public:
+    explicit JitSymbolRegistry(std::filesystem::path const& perfMapDir = {});
+
+    void notifyObjectLoaded(
+        ObjectKey                                  K,
+        llvm::object::ObjectFile const&            Obj,
+        llvm::RuntimeDyld::LoadedObjectInfo const& L
+    ) override;
+
+    void notifyFreeingObject(ObjectKey K) override;
+
+    std::optional<JitSymbolInfo> findSymbol(void const* address) const;
+};
+
+} // namespace lcj
@@ -1,9 +1,14 @@
 #include "lcj/engine/LazyJitEngine.h"
 #include "lcj/core/LeviCppJit.h"
+#include "lcj/engine/JitSymbolRegistry.h"
 #include "lcj/engine/ServerSymbolGenerator.h"
+#include "lcj/runtime/TickScheduler.h"
 #include "lcj/utils/LogOnError.h"
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
@@ -11,6 +16,13 @@
 
 #include <ll/api/base/MsvcPredefine.h>
 
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+
 namespace lcj {
 
 // __declspec(noreturn
@@ -46,11 +58,66 @@ unsigned char _addcarry_u64(
     return CarryVector >> 63;
 }
 
+// entry counters of script dylibs, also called by script code through lcj_call_enter/leave
+static void enterCall(void* calls) { ++*static_cast<std::atomic<size_t>*>(calls); }
+static void leaveCall(void* calls) {
+    auto& counter = *static_cast<std::atomic<size_t>*>(calls);
+    if (--counter == 0) {
+        counter.notify_all();
+    }
+}
+
+static void reportUnhandledException(char const* what) {
+    LeviCppJit::getInstance().getLogger().error(
+        "Script task dropped after an unhandled exception: {}",
+        what ? what : "unknown exception"
+    );
+}
+
+// Tears down dropped dylibs in two steps. Once no task or caller is inside a dylib any more,
+// its tasks and deinitializers run on the server thread in drop order, as script destructors may
+// touch game state. Removing the code and releasing the memory is left to a background thread.
+class DylibReclaimer {
+    llvm::orc::LLJIT& jit;
+
+    std::mutex                               droppedMutex;
+    std::deque<std::unique_ptr<Dylib::Impl>> dropped;
+
+    std::mutex                                mutex;
+    std::condition_variable                   queued;
+    std::vector<std::unique_ptr<Dylib::Impl>> queue;
+    bool                                      stopping{};
+    std::thread                               worker;
+
+    void deinitialize(Dylib::Impl& lib);
+
+    void reclaim(std::vector<std::unique_ptr<Dylib::Impl>>& batch);
+
+public:
+    explicit DylibReclaimer(llvm::orc::LLJIT& jit);
+    ~DylibReclaimer();
+
+    void enqueue(std::unique_ptr<Dylib::Impl>&& lib);
+
+    // server thread only, wait blocks until every dropped dylib became idle
+    void processDropped(bool wait);
+
+    void run();
+};
+
 struct LazyJitEngine::Impl {
+    std::unique_ptr<JitSymbolRegistry>    symbolRegistry;
     std::unique_ptr<llvm::orc::LLLazyJIT> JitEngine;
+    std::unique_ptr<DylibReclaimer>       reclaimer;
 };
 
 LazyJitEngine::LazyJitEngine() : impl(std::make_unique<Impl>()) {
+    impl->symbolRegistry = std::make_unique<JitSymbolRegistry>(
+        LeviCppJit::getInstance().getConfig().writePerfMap
+            ? LeviCppJit::getInstance().getDataDir() / u8"perf"
+            : std::filesystem::path{}
+    );
+
     auto ES = std::make_unique<llvm::orc::ExecutionSession>(
         CheckExcepted(llvm::orc::SelfExecutorProcessControl::Create())
     );
@@ -79,25 +146,75 @@ LazyJitEngine::LazyJitEngine() : impl(std::make_unique<Impl>()) {
             //           CheckExcepted(llvm::jitlink::InProcessMemoryManager::Create())
             //       );
             //   })
+            .setObjectLinkingLayerCreator(
+                [&](llvm::orc::ExecutionSession& ES, const llvm::Triple&)
+                    -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+                    auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(ES, [] {
+                        return std::make_unique<llvm::SectionMemoryManager>();
+                    });
+                    // same as the LLJIT default for COFF
+                    layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+                    layer->setAutoClaimResponsibilityForObjectSymbols(true);
+                    layer->registerJITEventListener(*impl->symbolRegistry);
+                    return layer;
+                }
+            )
             .setNumCompileThreads(std::thread::hardware_concurrency())
             .create()
     );
+    impl->reclaimer = std::make_unique<DylibReclaimer>(*impl->JitEngine);
 }
 LazyJitEngine::~LazyJitEngine() = default;
 
+std::optional<JitSymbolInfo> LazyJitEngine::findSymbol(void const* address) const {
+    return impl->symbolRegistry->findSymbol(address);
+}
+
+void LazyJitEngine::processDroppedDylibs() { impl->reclaimer->processDropped(false); }
+
 struct Dylib::Impl {
+    struct CachedSymbol {
+        llvm::orc::SymbolStringPtr name;
+        void*                      address{};
+    };
+
     llvm::orc::JITDylib& lib;
     llvm::orc::LLJIT&    jit;
+    DylibReclaimer&      reclaimer;
+
+    TickScheduler*                        scheduler{};
+    std::unique_ptr<TickScheduler::Owner> taskOwner;
+
+    bool                initialized{};
+    std::atomic<size_t> activeCalls{};
+
+    std::mutex                    mutex;
+    llvm::StringMap<CachedSymbol> symbols;
+
+    CachedSymbol& getCachedSymbol(std::string_view name) {
+        auto& entry = symbols.try_emplace(name).first->second;
+        if (!entry.name) {
+            entry.name = jit.mangleAndIntern(name);
+        }
+        return entry;
+    }
 };
 Dylib LazyJitEngine::createDylib(std::string_view name) {
-    Dylib res{CheckExcepted(impl->JitEngine->createJITDylib(std::string{name})), *impl->JitEngine};
+    Dylib res{
+        CheckExcepted(impl->JitEngine->createJITDylib(std::string{name})),
+        *impl->JitEngine,
+        *impl->reclaimer
+    };
     return res;
 }
-Dylib::Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit)
-: impl(std::make_unique<Impl>(lib, jit)) {
+Dylib::Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit, DylibReclaimer& reclaimer)
+: impl(std::make_unique<Impl>(lib, jit, reclaimer)) {
 
     auto& es = impl->jit.getExecutionSession();
 
+    impl->scheduler = &LeviCppJit::getInstance().getScheduler();
+    impl->taskOwner = impl->scheduler->createOwner();
+
     // CheckExcepted(lib.define(llvm::orc::absoluteSymbols({
     //     {es.intern("_CxxThrowException"),
     //      llvm::JITEvaluatedSymbol::fromPointer(
@@ -125,7 +242,49 @@ Dylib::Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit)
         {es.intern("_subborrow_u64"),
          llvm::JITEvaluatedSymbol::fromPointer(_subborrow_u64, llvm::JITSymbolFlags::Exported)},
         {es.intern("_addcarry_u64"),
-         llvm::JITEvaluatedSymbol::fromPointer(_addcarry_u64, llvm::JITSymbolFlags::Exported)}
+         llvm::JITEvaluatedSymbol::fromPointer(_addcarry_u64, llvm::JITSymbolFlags::Exported)},
+        {es.intern("lcj_task_owner"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             impl->taskOwner.get(),
+             llvm::JITSymbolFlags::Exported
+         )},
+        {es.intern("lcj_dylib_calls"),
+         llvm::JITEvaluatedSymbol::fromPointer(&impl->activeCalls, llvm::JITSymbolFlags::Exported)},
+        {es.intern("lcj_call_enter"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             enterCall,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_call_leave"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             leaveCall,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_coro_unhandled_exception"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             reportUnhandledException,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_coro_allocate"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             TickScheduler::coroAllocate,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_coro_deallocate"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             TickScheduler::coroDeallocate,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_coro_schedule"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             TickScheduler::coroSchedule,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )},
+        {es.intern("lcj_coro_schedule_background"),
+         llvm::JITEvaluatedSymbol::fromPointer(
+             TickScheduler::coroScheduleBackground,
+             llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable
+         )}
     })));
     for (auto& str : std::vector<std::string>{
              (LeviCppJit::getInstance().getDataDir() / u8R"(library\msvc\vcruntime.lib)").string(),
@@ -160,12 +319,137 @@ Dylib::Dylib(llvm::orc::JITDylib& lib, llvm::orc::LLJIT& jit)
     // ));
 }
 
-Dylib::~Dylib() { CheckExcepted(impl->jit.getExecutionSession().removeJITDylib(impl->lib)); }
-Dylib::Dylib(Dylib&&) noexcept            = default;
-Dylib& Dylib::operator=(Dylib&&) noexcept = default;
+void Dylib::release() {
+    if (impl) {
+        impl->reclaimer.enqueue(std::move(impl));
+    }
+}
+Dylib::~Dylib() { release(); }
+Dylib::Dylib(Dylib&&) noexcept = default;
+Dylib& Dylib::operator=(Dylib&& other) noexcept {
+    if (this != &other) {
+        release();
+        impl = std::move(other.impl);
+    }
+    return *this;
+}
+
+void Dylib::initialize() {
+    CheckExcepted(impl->jit.initialize(impl->lib));
+    impl->initialized = true;
+}
+void Dylib::deinitialize() {
+    impl->initialized = false;
+    CheckExcepted(impl->jit.deinitialize(impl->lib));
+}
+
+Dylib::CallGuard::CallGuard(std::atomic<size_t>& activeCalls) : activeCalls(&activeCalls) {
+    enterCall(&activeCalls);
+}
+Dylib::CallGuard::CallGuard(CallGuard&& other) noexcept
+: activeCalls(std::exchange(other.activeCalls, nullptr)) {}
+Dylib::CallGuard::~CallGuard() {
+    if (activeCalls) {
+        leaveCall(activeCalls);
+    }
+}
+
+Dylib::CallGuard Dylib::enter() { return CallGuard{impl->activeCalls}; }
+
+DylibReclaimer::DylibReclaimer(llvm::orc::LLJIT& jit) : jit(jit), worker([this] { run(); }) {}
+DylibReclaimer::~DylibReclaimer() {
+    // the engine goes away on the server thread during unload
+    processDropped(true);
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+    queued.notify_all();
+    worker.join();
+}
+
+void DylibReclaimer::enqueue(std::unique_ptr<Dylib::Impl>&& lib) {
+    // stop background jobs of the dylib from starting while it waits for the next tick
+    lib->taskOwner->cancelled = true;
+
+    std::lock_guard lock{droppedMutex};
+    dropped.push_back(std::move(lib));
+}
+
+void DylibReclaimer::processDropped(bool wait) {
+    auto isBusy = [](Dylib::Impl& lib) {
+        return lib.taskOwner->running != 0 || lib.activeCalls != 0;
+    };
+    std::vector<std::unique_ptr<Dylib::Impl>> batch;
+    for (;;) {
+        std::unique_ptr<Dylib::Impl> lib;
+        {
+            std::lock_guard lock{droppedMutex};
+            if (dropped.empty() || (!wait && isBusy(*dropped.front()))) {
+                // keep the drop order, the rest is retried next tick
+                break;
+            }
+            lib = std::move(dropped.front());
+            dropped.pop_front();
+        }
+        if (wait) {
+            while (auto calls = lib->activeCalls.load()) {
+                lib->activeCalls.wait(calls);
+            }
+        } else if (isBusy(*lib)) {
+            // a call entered after the check, the tick must not block on it
+            std::lock_guard lock{droppedMutex};
+            dropped.push_front(std::move(lib));
+            break;
+        }
+        deinitialize(*lib);
+        batch.push_back(std::move(lib));
+    }
+    if (batch.empty()) {
+        return;
+    }
+    {
+        std::lock_guard lock{mutex};
+        std::move(batch.begin(), batch.end(), std::back_inserter(queue));
+    }
+    queued.notify_one();
+}
+
+void DylibReclaimer::deinitialize(Dylib::Impl& lib) {
+    lib.scheduler->cancel(*lib.taskOwner);
+    if (lib.initialized) {
+        if (auto err = jit.deinitialize(lib.lib)) {
+            jit.getExecutionSession().reportError(std::move(err));
+        }
+    }
+}
+
+void DylibReclaimer::run() {
+    std::vector<std::unique_ptr<Dylib::Impl>> batch;
+    for (;;) {
+        {
+            std::unique_lock lock{mutex};
+            queued.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            batch.swap(queue);
+        }
+        reclaim(batch);
+        batch.clear();
+    }
+}
+
+void DylibReclaimer::reclaim(std::vector<std::unique_ptr<Dylib::Impl>>& batch) {
+    auto& es = jit.getExecutionSession();
 
-void Dylib::initialize() { CheckExcepted(impl->jit.initialize(impl->lib)); }
-void Dylib::deinitialize() { CheckExcepted(impl->jit.deinitialize(impl->lib)); }
+    // only idle and deinitialized dylibs get here
+    for (auto& lib : batch) {
+        if (auto err = es.removeJITDylib(lib->lib)) {
+            es.reportError(std::move(err));
+        }
+    }
+}
 
 void Dylib::addModule(llvm::orc::ThreadSafeModule&& module) {
     // tmodule.withModuleDo([&, this](llvm::Module& module) {
@@ -186,7 +470,67 @@ void Dylib::addModule(llvm::orc::ThreadSafeModule&& module) {
     // });
     CheckExcepted(impl->jit.addIRModule(impl->lib, std::move(module)));
 }
+bool Dylib::hasPendingTasks() const { return impl->taskOwner->pending != 0; }
+
+void Dylib::addObject(std::unique_ptr<llvm::MemoryBuffer>&& object) {
+    CheckExcepted(impl->jit.addObjectFile(impl->lib, std::move(object)));
+}
 void* Dylib::lookupImpl(std::string_view name) {
-    return CheckExcepted(impl->jit.lookup(impl->lib, name)).toPtr<void*>();
+    llvm::orc::SymbolStringPtr symbol;
+    {
+        std::lock_guard lock{impl->mutex};
+
+        auto& entry = impl->getCachedSymbol(name);
+        if (entry.address) {
+            return entry.address;
+        }
+        symbol = entry.name;
+    }
+    auto address = CheckExcepted(impl->jit.lookupLinkerMangled(impl->lib, symbol)).toPtr<void*>();
+
+    std::lock_guard lock{impl->mutex};
+    return impl->getCachedSymbol(name).address = address;
+}
+std::vector<void*> Dylib::lookupBatchImpl(std::span<std::string_view const> names) {
+    std::vector<void*>         res(names.size());
+    llvm::orc::SymbolLookupSet request;
+    {
+        std::lock_guard lock{impl->mutex};
+
+        for (size_t i = 0; i < names.size(); i++) {
+            auto& entry = impl->getCachedSymbol(names[i]);
+            if (entry.address) {
+                res[i] = entry.address;
+            } else {
+                request.add(entry.name, llvm::orc::SymbolLookupFlags::WeaklyReferencedSymbol);
+            }
+        }
+    }
+    if (request.empty()) {
+        return res;
+    }
+    request.removeDuplicates();
+
+    auto resolved = CheckExcepted(impl->jit.getExecutionSession().lookup(
+        llvm::orc::makeJITDylibSearchOrder(
+            &impl->lib,
+            llvm::orc::JITDylibLookupFlags::MatchAllSymbols
+        ),
+        std::move(request)
+    ));
+
+    std::lock_guard lock{impl->mutex};
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (res[i]) {
+            continue;
+        }
+        auto& entry = impl->getCachedSymbol(names[i]);
+        if (auto iter = resolved.find(entry.name); iter != resolved.end()) {
+            entry.address = res[i] =
+                llvm::jitTargetAddressToPointer<void*>(iter->second.getAddress());
+        }
+    }
+    return res;
 }
 } // namespace lcj
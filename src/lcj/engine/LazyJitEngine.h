@@ -1,9 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string_view>
 
 #include "lcj/engine/Dylib.h"
+#include "lcj/engine/JitSymbolInfo.h"
 
 namespace lcj {
 class LazyJitEngine {
@@ -15,5 +17,10 @@ class LazyJitEngine {
     ~LazyJitEngine();
 
     Dylib createDylib(std::string_view name);
+
+    std::optional<JitSymbolInfo> findSymbol(void const* address) const;
+
+    // deinitializes dropped dylibs that became idle, called from the server tick
+    void processDroppedDylibs();
 };
 } // namespace lcj
@@ -0,0 +1,257 @@
+#include "TickScheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace lcj {
+
+// frames are served from per size class free lists with a small header in front, holding the
+// size class and the scheduler that owns the block
+static constexpr size_t frameHeaderSize  = 16;
+static constexpr size_t frameGranularity = 64;
+static constexpr size_t frameClassCount  = 64;
+
+// timers hash into a wheel by due tick, longer delays just stay in their slot for more rounds
+static constexpr size_t wheelSize = 256;
+
+// fifo of intrusive nodes
+struct TaskList {
+    TickScheduler::TaskNode* head{};
+    TickScheduler::TaskNode* tail{};
+
+    [[nodiscard]] bool empty() const { return !head; }
+
+    void push(TickScheduler::TaskNode* node) {
+        node->next                 = nullptr;
+        (tail ? tail->next : head) = node;
+        tail                       = node;
+    }
+
+    TickScheduler::TaskNode* pop() {
+        auto node = head;
+        if (!(head = node->next)) {
+            tail = nullptr;
+        }
+        return node;
+    }
+
+    // moves the matching nodes to out, both keep their order
+    template <class Pred>
+    void extract(Pred&& pred, TaskList& out) {
+        TaskList kept;
+        while (!empty()) {
+            auto node = pop();
+            (pred(*node) ? out : kept).push(node);
+        }
+        *this = kept;
+    }
+};
+
+struct TickScheduler::Impl {
+    std::mutex                      mutex;
+    uint64_t                        currentTick{};
+    std::array<TaskList, wheelSize> wheel;
+    TaskList                        completed;
+
+    std::mutex                             poolMutex;
+    std::array<void*, frameClassCount + 1> freeLists{};
+
+    std::mutex               jobMutex;
+    std::condition_variable  jobAdded;
+    std::condition_variable  jobFinished;
+    TaskList                 jobs;
+    bool                     stopping{};
+    std::vector<std::thread> workers;
+
+    void workerLoop() {
+        for (;;) {
+            TaskNode* node;
+            {
+                std::unique_lock lock{jobMutex};
+                jobAdded.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                node = jobs.pop();
+                node->owner->running++;
+            }
+            // the node belongs to the frame, which the tick may destroy once it is completed
+            auto& owner = *node->owner;
+            if (!owner.cancelled) {
+                node->work(node->data);
+            }
+            {
+                std::lock_guard lock{mutex};
+                completed.push(node);
+            }
+            {
+                std::lock_guard lock{jobMutex};
+                owner.running--;
+            }
+            jobFinished.notify_all();
+        }
+    }
+};
+
+TickScheduler::TickScheduler(size_t backgroundThreads) : impl(std::make_unique<Impl>()) {
+    for (size_t i = 0; i < backgroundThreads; i++) {
+        impl->workers.emplace_back([this] { impl->workerLoop(); });
+    }
+}
+TickScheduler::~TickScheduler() {
+    {
+        std::lock_guard lock{impl->jobMutex};
+        impl->stopping = true;
+    }
+    impl->jobAdded.notify_all();
+    for (auto& worker : impl->workers) {
+        worker.join();
+    }
+    for (auto block : impl->freeLists) {
+        while (block) {
+            auto next = *static_cast<void**>(block);
+            ::operator delete(block);
+            block = next;
+        }
+    }
+}
+
+std::unique_ptr<TickScheduler::Owner> TickScheduler::createOwner() {
+    auto owner       = std::make_unique<Owner>();
+    owner->scheduler = this;
+    return owner;
+}
+
+void TickScheduler::cancel(Owner& owner) {
+    owner.cancelled = true;
+
+    auto ownedBy = [&](TaskNode& node) { return node.owner == &owner; };
+
+    TaskList dropped;
+    {
+        // script code must not be running on another thread when the caller unloads it
+        std::unique_lock lock{impl->jobMutex};
+        impl->jobFinished.wait(lock, [&] { return owner.running == 0; });
+        impl->jobs.extract(ownedBy, dropped);
+    }
+    {
+        std::lock_guard lock{impl->mutex};
+        for (auto& slot : impl->wheel) {
+            slot.extract(ownedBy, dropped);
+        }
+        impl->completed.extract(ownedBy, dropped);
+    }
+    // runs the destructors of the frame locals, outside of the locks as they are script code
+    while (!dropped.empty()) {
+        auto node = dropped.pop();
+        owner.pending--;
+        node->destroy(node->frame);
+    }
+    // entries taken by a tick before the sweep are destroyed by that tick
+    std::unique_lock lock{impl->jobMutex};
+    impl->jobFinished.wait(lock, [&] { return owner.running == 0; });
+}
+
+void TickScheduler::schedule(TaskNode& node, uint64_t ticks) {
+    node.owner->pending++;
+    std::lock_guard lock{impl->mutex};
+    node.due = impl->currentTick + std::max<uint64_t>(ticks, 1);
+    impl->wheel[node.due % wheelSize].push(&node);
+}
+
+void TickScheduler::scheduleBackground(TaskNode& node) {
+    node.owner->pending++;
+    {
+        std::lock_guard lock{impl->jobMutex};
+        impl->jobs.push(&node);
+    }
+    impl->jobAdded.notify_one();
+}
+
+void* TickScheduler::allocateFrame(size_t size) {
+    size_t sizeClass = (size + frameHeaderSize + frameGranularity - 1) / frameGranularity;
+    void*  block     = nullptr;
+    if (sizeClass > frameClassCount) {
+        sizeClass = 0;
+        block     = ::operator new(size + frameHeaderSize);
+    } else {
+        {
+            std::lock_guard lock{impl->poolMutex};
+            if ((block = impl->freeLists[sizeClass])) {
+                impl->freeLists[sizeClass] = *static_cast<void**>(block);
+            }
+        }
+        if (!block) {
+            block = ::operator new(sizeClass * frameGranularity);
+        }
+    }
+    static_cast<size_t*>(block)[0]         = sizeClass;
+    static_cast<TickScheduler**>(block)[1] = this;
+    return static_cast<char*>(block) + frameHeaderSize;
+}
+
+void TickScheduler::deallocateFrame(void* frame) {
+    void* block     = static_cast<char*>(frame) - frameHeaderSize;
+    auto  sizeClass = *static_cast<size_t*>(block);
+    if (sizeClass == 0) {
+        ::operator delete(block);
+        return;
+    }
+    std::lock_guard lock{impl->poolMutex};
+    *static_cast<void**>(block) = impl->freeLists[sizeClass];
+    impl->freeLists[sizeClass]  = block;
+}
+
+void TickScheduler::tick() {
+    TaskList batch;
+    {
+        std::lock_guard lock{impl->mutex};
+        auto            now = ++impl->currentTick;
+        auto            due = [&](TaskNode& node) { return node.due <= now; };
+        impl->wheel[now % wheelSize].extract(due, batch);
+        while (!impl->completed.empty()) {
+            batch.push(impl->completed.pop());
+        }
+        for (auto node = batch.head; node; node = node->next) {
+            node->owner->running++;
+        }
+    }
+    while (!batch.empty()) {
+        // resuming may reuse the node's storage for the next await
+        auto  node  = batch.pop();
+        auto& owner = *node->owner;
+        owner.pending--;
+        if (owner.cancelled) {
+            node->destroy(node->frame);
+        } else {
+            node->resume(node->frame);
+        }
+        // a cancel from another thread waits until the batch is done with the owner
+        if (--owner.running == 0 && owner.cancelled) {
+            std::lock_guard lock{impl->jobMutex};
+            impl->jobFinished.notify_all();
+        }
+    }
+}
+
+void* TickScheduler::coroAllocate(void* owner, size_t size) {
+    return static_cast<Owner*>(owner)->scheduler->allocateFrame(size);
+}
+void TickScheduler::coroDeallocate(void* frame) {
+    auto block = static_cast<char*>(frame) - frameHeaderSize;
+    reinterpret_cast<TickScheduler**>(block)[1]->deallocateFrame(frame);
+}
+void TickScheduler::coroSchedule(void* node, uint64_t ticks) {
+    auto& task = *static_cast<TaskNode*>(node);
+    task.owner->scheduler->schedule(task, ticks);
+}
+void TickScheduler::coroScheduleBackground(void* node) {
+    auto& task = *static_cast<TaskNode*>(node);
+    task.owner->scheduler->scheduleBackground(task);
+}
+} // namespace lcj
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace lcj {
+// Resumes suspended script coroutines from the server tick. Scripts reach it through the
+// lcj_coro_* runtime symbols defined in every Dylib, see script/lcj/Coroutine.h.
+class TickScheduler {
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+public:
+    // one per Dylib, which outlives all of its tasks as they are cancelled before it goes away
+    struct Owner {
+        TickScheduler*      scheduler{};
+        std::atomic<size_t> pending{};
+        std::atomic<size_t> running{};
+        std::atomic<bool>   cancelled{};
+    };
+
+    using ResumeFn  = void (*)(void* frame);
+    using DestroyFn = void (*)(void* frame);
+    using WorkFn    = void (*)(void* data);
+
+    // Intrusive scheduling record, it lives in the awaiter inside the suspended frame, so waiting
+    // allocates nothing. Mirrors lcj_task_node in script/lcj/Coroutine.h.
+    struct TaskNode {
+        TaskNode* next;
+        Owner*    owner;
+        void*     frame;
+        ResumeFn  resume;
+        DestroyFn destroy;
+        WorkFn    work;
+        void*     data;
+        uint64_t  due;
+    };
+
+    explicit TickScheduler(size_t backgroundThreads);
+    ~TickScheduler();
+
+    std::unique_ptr<Owner> createOwner();
+
+    // destroys all pending tasks of the owner, their frames go back to the pool
+    void cancel(Owner& owner);
+
+    void schedule(TaskNode& node, uint64_t ticks);
+
+    void scheduleBackground(TaskNode& node);
+
+    void* allocateFrame(size_t size);
+
+    void deallocateFrame(void* frame);
+
+    // runs on the server thread once per game tick
+    void tick();
+
+    // the runtime symbols reach the scheduler through the owner or the frame header, never the
+    // plugin instance, which is already gone while the engine drops tasks during unload
+    static void* coroAllocate(void* owner, size_t size);
+    static void  coroDeallocate(void* frame);
+    static void  coroSchedule(void* node, uint64_t ticks);
+    static void  coroScheduleBackground(void* node);
+};
+} // namespace lcj
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+namespace lcj {
+
+template <size_t N>
+struct FixedString {
+    char data[N]{};
+
+    consteval FixedString(char const (&str)[N]) { std::copy_n(str, N, data); }
+
+    [[nodiscard]] constexpr std::string_view view() const { return {data, N - 1}; }
+};
+
+// Compile-time MSVC name mangling for free functions, e.g.
+// msvc_mangle::functionName<"eval", std::any()> == "?eval@@YA?AVany@std@@XZ".
+// Supports fundamental types, pointers, references and non-template classes/enums;
+// anything else fails to compile, pass the mangled name by hand for those.
+namespace msvc_mangle {
+
+// not constexpr, so a name that cannot be mangled fails the constant evaluation
+inline void unsupportedName() {}
+
+// dependent false, shows the offending type in the static_assert diagnostic
+template <class T>
+inline constexpr bool unsupportedType = false;
+
+template <class T>
+consteval std::string_view rawTypeName() {
+    std::string_view sig   = __FUNCSIG__;
+    auto             begin = sig.find("rawTypeName<") + sizeof("rawTypeName<") - 1;
+    auto             end   = sig.rfind(">(void)");
+    return sig.substr(begin, end - begin);
+}
+
+struct Buffer {
+    char   data[512]{};
+    size_t size{};
+
+    constexpr void push(char c) { data[size++] = c; }
+    constexpr void append(std::string_view str) {
+        for (char c : str) push(c);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const { return {data, size}; }
+};
+
+struct Context {
+    Buffer           out;
+    std::string_view names[10]{};
+    size_t           nameCount{};
+    std::string_view args[10]{};
+    size_t           argCount{};
+
+    constexpr void sourceName(std::string_view name) {
+        for (size_t i = 0; i < nameCount; i++) {
+            if (names[i] == name) {
+                out.push(static_cast<char>('0' + i));
+                return;
+            }
+        }
+        if (nameCount < 10) names[nameCount++] = name;
+        out.append(name);
+        out.push('@');
+    }
+
+    // a::b::c -> c@b@a@@
+    constexpr void qualifiedName(std::string_view name) {
+        if (name.find_first_of("<>`'() ,") != std::string_view::npos) unsupportedName();
+        for (;;) {
+            auto pos = name.rfind("::");
+            if (pos == std::string_view::npos) {
+                sourceName(name);
+                break;
+            }
+            sourceName(name.substr(pos + 2));
+            name = name.substr(0, pos);
+        }
+        out.push('@');
+    }
+};
+
+template <class T>
+constexpr void cvQualifier(Context& ctx) {
+    if constexpr (std::is_const_v<T> && std::is_volatile_v<T>) ctx.out.push('D');
+    else if constexpr (std::is_volatile_v<T>) ctx.out.push('C');
+    else if constexpr (std::is_const_v<T>) ctx.out.push('B');
+    else ctx.out.push('A');
+}
+
+template <class T>
+constexpr void tagType(Context& ctx) {
+    using U   = std::remove_cv_t<T>;
+    auto name = rawTypeName<U>();
+    // __FUNCSIG__ spells the class-key, which is the only way to tell class from struct
+    name.remove_prefix(name.find(' ') + 1);
+    if constexpr (std::is_union_v<U>) {
+        ctx.out.push('T');
+    } else if constexpr (std::is_enum_v<U>) {
+        ctx.out.append("W4");
+    } else if constexpr (std::is_class_v<U>) {
+        ctx.out.push(rawTypeName<U>().starts_with("struct ") ? 'U' : 'V');
+    } else {
+        static_assert(unsupportedType<T>, "msvc_mangle: not a class, union or enum type");
+    }
+    ctx.qualifiedName(name);
+}
+
+template <class T>
+constexpr void type(Context& ctx) {
+    using U = std::remove_cv_t<T>;
+    if constexpr (std::is_void_v<U>) ctx.out.push('X');
+    else if constexpr (std::is_same_v<U, bool>) ctx.out.append("_N");
+    else if constexpr (std::is_same_v<U, char>) ctx.out.push('D');
+    else if constexpr (std::is_same_v<U, signed char>) ctx.out.push('C');
+    else if constexpr (std::is_same_v<U, unsigned char>) ctx.out.push('E');
+    else if constexpr (std::is_same_v<U, short>) ctx.out.push('F');
+    else if constexpr (std::is_same_v<U, unsigned short>) ctx.out.push('G');
+    else if constexpr (std::is_same_v<U, int>) ctx.out.push('H');
+    else if constexpr (std::is_same_v<U, unsigned int>) ctx.out.push('I');
+    else if constexpr (std::is_same_v<U, long>) ctx.out.push('J');
+    else if constexpr (std::is_same_v<U, unsigned long>) ctx.out.push('K');
+    else if constexpr (std::is_same_v<U, long long>) ctx.out.append("_J");
+    else if constexpr (std::is_same_v<U, unsigned long long>) ctx.out.append("_K");
+    else if constexpr (std::is_same_v<U, float>) ctx.out.push('M');
+    else if constexpr (std::is_same_v<U, double>) ctx.out.push('N');
+    else if constexpr (std::is_same_v<U, long double>) ctx.out.push('O');
+    else if constexpr (std::is_same_v<U, wchar_t>) ctx.out.append("_W");
+    else if constexpr (std::is_same_v<U, char8_t>) ctx.out.append("_Q");
+    else if constexpr (std::is_same_v<U, char16_t>) ctx.out.append("_S");
+    else if constexpr (std::is_same_v<U, char32_t>) ctx.out.append("_U");
+    else if constexpr (std::is_null_pointer_v<U>) ctx.out.append("$$T");
+    else if constexpr (std::is_pointer_v<U> && !std::is_function_v<std::remove_pointer_t<U>>) {
+        ctx.out.append("PE");
+        cvQualifier<std::remove_pointer_t<U>>(ctx);
+        type<std::remove_pointer_t<U>>(ctx);
+    } else if constexpr (std::is_lvalue_reference_v<U>) {
+        ctx.out.append("AE");
+        cvQualifier<std::remove_reference_t<U>>(ctx);
+        type<std::remove_reference_t<U>>(ctx);
+    } else if constexpr (std::is_rvalue_reference_v<U>) {
+        ctx.out.append("$$QE");
+        cvQualifier<std::remove_reference_t<U>>(ctx);
+        type<std::remove_reference_t<U>>(ctx);
+    } else if constexpr (std::is_class_v<U> || std::is_union_v<U> || std::is_enum_v<U>) {
+        tagType<U>(ctx);
+    } else {
+        static_assert(unsupportedType<T>, "msvc_mangle: unsupported type, pass the mangled name");
+    }
+}
+
+// arguments longer than one character are back-referenced by index
+template <class T>
+constexpr void argument(Context& ctx) {
+    auto key = rawTypeName<T>();
+    for (size_t i = 0; i < ctx.argCount; i++) {
+        if (ctx.args[i] == key) {
+            ctx.out.push(static_cast<char>('0' + i));
+            return;
+        }
+    }
+    auto before = ctx.out.size;
+    type<T>(ctx);
+    if (ctx.out.size - before > 1 && ctx.argCount < 10) ctx.args[ctx.argCount++] = key;
+}
+
+template <class R, class... Args>
+consteval Buffer function(std::string_view name, R (*)(Args...)) {
+    Context ctx;
+    ctx.out.push('?');
+    ctx.qualifiedName(name);
+    // global function, __cdecl
+    ctx.out.append("YA");
+    // tag types and cv-qualified returns are prefixed with ? and their cv
+    static_assert(
+        !std::is_pointer_v<R> || std::is_same_v<R, std::remove_cv_t<R>>,
+        "msvc_mangle: cv-qualified pointer return types are not supported"
+    );
+    if constexpr (std::is_class_v<R> || std::is_union_v<R> || std::is_enum_v<R>
+                  || !std::is_same_v<R, std::remove_cv_t<R>>) {
+        ctx.out.push('?');
+        cvQualifier<R>(ctx);
+    }
+    type<R>(ctx);
+    if constexpr (sizeof...(Args) == 0) {
+        ctx.out.push('X');
+    } else {
+        (argument<Args>(ctx), ...);
+        ctx.out.push('@');
+    }
+    ctx.out.push('Z');
+    return ctx.out;
+}
+
+template <FixedString Name, class Fn>
+inline constexpr Buffer functionBuffer = function(Name.view(), static_cast<Fn*>(nullptr));
+
+template <FixedString Name, class Fn>
+inline constexpr std::string_view functionName = functionBuffer<Name, Fn>.view();
+
+} // namespace msvc_mangle
+} // namespace lcj
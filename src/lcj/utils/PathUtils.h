@@ -0,0 +1,14 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace lcj {
+
+// llvm and clang expect utf-8 paths on every platform
+inline std::string pathToUtf8(std::filesystem::path const& path) {
+    auto str = path.u8string();
+    return {reinterpret_cast<char const*>(str.data()), str.size()};
+}
+
+} // namespace lcj
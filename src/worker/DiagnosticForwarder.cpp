@@ -0,0 +1,21 @@
+#include "DiagnosticForwarder.h"
+
+#include <clang/Basic/SourceManager.h>
+
+namespace lcj::worker {
+
+void DiagnosticForwarder::HandleDiagnostic(
+    clang::DiagnosticsEngine::Level DiagLevel,
+    const clang::Diagnostic&        Info
+) {
+    auto        sd   = clang::StoredDiagnostic{DiagLevel, Info};
+    auto&       file = sd.getLocation();
+    std::string s;
+    if (file.hasManager()) {
+        s += file.printToString(file.getManager()) + ": ";
+    }
+    s += sd.getMessage();
+
+    channel.write(MessageKind::Diagnostic, static_cast<uint32_t>(DiagLevel), s);
+}
+} // namespace lcj::worker
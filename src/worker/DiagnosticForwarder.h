@@ -0,0 +1,17 @@
+#pragma once
+
+#include "lcj/compiler/WorkerProtocol.h"
+
+#include <clang/Basic/Diagnostic.h>
+
+namespace lcj::worker {
+class DiagnosticForwarder : public clang::DiagnosticConsumer {
+    Channel& channel;
+
+public:
+    explicit DiagnosticForwarder(Channel& channel) : channel(channel) {}
+
+    void HandleDiagnostic(clang::DiagnosticsEngine::Level DiagLevel, const clang::Diagnostic& Info)
+        override;
+};
+} // namespace lcj::worker
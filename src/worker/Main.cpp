@@ -0,0 +1,124 @@
+#include "DiagnosticForwarder.h"
+
+#include "lcj/compiler/CxxCompileLayer.h"
+#include "lcj/compiler/WorkerProtocol.h"
+
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
+
+#include <Windows.h>
+
+// Out-of-process compile worker: runs the clang front-end and codegen for the plugin and sends the
+// resulting object files back over the stdin/stdout pipes, see lcj/compiler/WorkerProtocol.h.
+// usage: LeviCppJitCompiler <data dir> [--portable]
+int wmain(int argc, wchar_t** argv) {
+    using namespace lcj;
+    using namespace lcj::worker;
+
+    if (argc < 2) {
+        return 1;
+    }
+
+    // keep the pipe for ourselves, so nothing written to stdout can corrupt the protocol
+    HANDLE output{};
+    if (!DuplicateHandle(
+            GetCurrentProcess(),
+            GetStdHandle(STD_OUTPUT_HANDLE),
+            GetCurrentProcess(),
+            &output,
+            0,
+            FALSE,
+            DUPLICATE_SAME_ACCESS
+        )) {
+        return 1;
+    }
+    // only the pipes are inherited, so there is no stderr to point stdout at
+    FILE* discarded{};
+    freopen_s(&discarded, "NUL", "w", stdout);
+    SetStdHandle(STD_OUTPUT_HANDLE, nullptr);
+
+    Channel channel{GetStdHandle(STD_INPUT_HANDLE), output};
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    // must match the target machine of LazyJitEngine
+    auto machineBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!machineBuilder) {
+        llvm::consumeError(machineBuilder.takeError());
+        return 1;
+    }
+    auto& targetOptions               = machineBuilder->getOptions();
+    targetOptions.EmulatedTLS         = true;
+    targetOptions.ExplicitEmulatedTLS = true;
+    targetOptions.ExceptionModel      = llvm::ExceptionHandling::WinEH;
+
+    auto targetMachine = machineBuilder->createTargetMachine();
+    if (!targetMachine) {
+        llvm::consumeError(targetMachine.takeError());
+        return 1;
+    }
+    llvm::orc::SimpleCompiler compiler{**targetMachine};
+
+    bool portableTarget = argc > 2 && std::wstring_view{argv[2]} == L"--portable";
+
+    CxxCompileLayer compileLayer{
+        argv[1],
+        std::make_unique<DiagnosticForwarder>(channel),
+        portableTarget
+    };
+
+    Message request;
+    while (channel.read(request)) {
+        auto prefix  = std::string_view{request.payload}.substr(0, request.param);
+        auto content = std::string_view{request.payload}.substr(request.param);
+        switch (request.kind) {
+        case MessageKind::Compile: {
+            auto module = compileLayer.compileRaw(content, prefix);
+            if (!module) {
+                channel.write(MessageKind::Failed);
+                break;
+            }
+            auto object = module.withModuleDo([&](llvm::Module& m) { return compiler(m); });
+            if (!object) {
+                channel.write(
+                    MessageKind::Diagnostic,
+                    static_cast<uint32_t>(clang::DiagnosticsEngine::Level::Error),
+                    llvm::toString(object.takeError())
+                );
+                channel.write(MessageKind::Failed);
+                break;
+            }
+            auto& stats = compileLayer.getLastCompileStats();
+            channel.write(
+                MessageKind::Object,
+                {reinterpret_cast<char const*>(&stats), sizeof(stats)},
+                (*object)->getBuffer()
+            );
+            break;
+        }
+        case MessageKind::GeneratePch: {
+            auto path = std::filesystem::path{
+                std::u8string_view{reinterpret_cast<char8_t const*>(prefix.data()), prefix.size()}
+            };
+            if (compileLayer.generatePch(content, path)) {
+                channel.write(MessageKind::Done);
+            } else {
+                channel.write(MessageKind::Failed);
+            }
+            break;
+        }
+        case MessageKind::Shutdown:
+            return 0;
+        default:
+            return 1;
+        }
+    }
+    return 0;
+}
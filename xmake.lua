@@ -7,6 +7,33 @@ add_requires("llvm-prebuilt 16.0.6")
 
 set_runtimes("MD")
 
+target("LeviCppJitCompiler")
+    add_cxflags(
+        "/EHa", 
+        "/utf-8" 
+    )
+    add_defines(
+        "_HAS_CXX23=1",
+        "NOMINMAX",
+        "UNICODE"
+    )
+    add_files(
+        "src/lcj/compiler/CxxCompileLayer.cpp",
+        "src/lcj/compiler/HeaderArchive.cpp",
+        "src/lcj/compiler/WorkerProtocol.cpp",
+        "src/worker/**.cpp"
+    )
+    add_includedirs(
+        "src"
+    )
+    add_packages(
+        "llvm-prebuilt"
+    )
+    set_exceptions("none")
+    set_kind("binary")
+    set_languages("cxx20")
+    set_symbols("debug")
+
 target("LeviCppJit")
     add_cxflags(
         "/EHa", 
@@ -17,8 +44,11 @@ target("LeviCppJit")
         "NOMINMAX",
         "UNICODE"
     )
+    add_deps(
+        "LeviCppJitCompiler"
+    )
     add_files(
-        "src/**.cpp"
+        "src/**.cpp|worker/**.cpp"
     )
     add_includedirs(
         "src"
@@ -48,6 +78,12 @@ target("LeviCppJit")
             pluginName = target:name(),
             pluginFile = path.filename(target:targetfile()),
             pluginVersion = major .. "." .. minor .. "." .. patch,
+            extraFiles = {
+                target:dep("LeviCppJitCompiler"):targetfile()
+            },
+            extraDirs = {
+                {"script", "data/header/script"}
+            },
         }
         
         plugin_packer.pack_plugin(target,plugin_define)